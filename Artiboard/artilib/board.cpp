@@ -8,8 +8,6 @@ namespace arti {
 	const Piece Piece::EMPTY(' ');
 	const Piece Piece::OUT_OF_BOUNDS(out_of_bounds);
 
-	Piece::Piece(square_value_t v): _value(v) {};
-
 	std::string Piece::to_string() const {
 		std::string result;
 		result.push_back(_value);
@@ -20,22 +18,43 @@ namespace arti {
 		return os;
 	}
 
-	Board::Board() : _data(), _it_b(this,0,0), _it_e(this,7,7) {};
-	Board::Board(const Board &b) : _data(b._data), _it_b(this,0,0), _it_e(this,7,7) {};
+	Board::Board() : _masks(), _hash(0), _data(), _tracked_count(0), _untracked(false) {};
 
-	const Piece& Board::at(const std::size_t colIndex, const std::size_t rowIndex) const {
-		if (colIndex < 0 || rowIndex < 0 || colIndex > 7 || rowIndex > 7)
-			return Piece::OUT_OF_BOUNDS;
-		else
-			return _data[rowIndex * 8 + colIndex];
+	Board::hash_t Board::hash_of(const ordinal_t squareIndex, const Piece &value) {
+		if (value.is_empty())
+			return 0;
+		// splitmix64 of the (square,value) pair; a fixed, well mixed key without a table
+		return splitmix64(((hash_t) (unsigned char) value.index() << 6 | squareIndex) * 0x9E3779B97F4A7C15ULL);
 	}
 
 	void Board::place(const std::size_t colIndex, const std::size_t rowIndex, const Piece &v) {
-		if (colIndex < 0 || rowIndex < 0 || colIndex > 7 || rowIndex > 7)
+		if (colIndex > 7 || rowIndex > 7)
 			throw runtime_error_ex("index out of bounds: col=%d row=%d",colIndex,rowIndex);
 		else if (v == Piece::OUT_OF_BOUNDS)
 			throw runtime_error_ex("cannot set square to out of bounds: col=%d row=%d",colIndex,rowIndex);
-		_data[rowIndex * 8 + colIndex] = v;
+		const index_t i = rowIndex * 8 + colIndex;
+		const Piece old = _data[i];
+		if (old == v)
+			return;
+		_data[i] = v;
+		_hash ^= hash_of(i,old) ^ hash_of(i,v);
+		const square_mask_t bit = square_mask_t(1) << i;
+		bool placed = v.is_empty();
+		for (int k = 0; k < _tracked_count; k++) {
+			if (_tracked[k] == old)
+				_masks[k] &= ~bit;
+			else if (_tracked[k] == v) {
+				_masks[k] |= bit;
+				placed = true;
+			}
+		}
+		if (!placed) {
+			if (_tracked_count < tracked_pieces) {
+				_tracked[_tracked_count] = v;
+				_masks[_tracked_count++] = bit;
+			} else
+				_untracked = true;
+		}
 	}
 
 	void Board::operator()(const Region& ss, const Piece &value) {
@@ -43,20 +62,50 @@ namespace arti {
 			place(s->file(),s->rank(),value);
 	}
 
+	bool Board::tracked_mask(const Piece &value, square_mask_t &m) const {
+		for (int k = 0; k < _tracked_count; k++)
+			if (_tracked[k] == value) {
+				m = _masks[k];
+				return true;
+			}
+		if (_untracked)
+			return false;
+		// every piece on the board has a mask, the rest of the squares are empty
+		m = 0;
+		if (value.is_empty()) {
+			for (int k = 0; k < _tracked_count; k++)
+				m |= _masks[k];
+			m = ~m;
+		}
+		return true;
+	}
+
+	square_mask_t Board::mask_of(const Piece &value) const {
+		square_mask_t result = 0;
+		if (tracked_mask(value,result))
+			return result;
+		for (ordinal_t i = 0; i < _data.size(); i++)
+			if (_data[i] == value)
+				result |= square_mask_t(1) << i;
+		return result;
+	}
+
 	int Board::count(const Region& ss, const Piece &value) const {
-		register int result = 0;
-		for (auto s = ss.begin(); s != ss.end(); s++)
-			if (at(s->file(),s->rank()) == value)
+		square_mask_t m;
+		if (tracked_mask(value,m))
+			return popcount(m & ss.mask());
+		int result = 0;
+		for (square_mask_t rest = ss.mask(); rest != 0; rest &= rest - 1)
+			if (_data[lowest_index(rest)] == value)
 				result++;
-		return result;	
+		return result;
 	}
 
 	Region::const_iterator Board::find(const Region& ss, const Piece &value) const {
-		for (auto s = ss.cbegin(); s != ss.cend(); s++) {
-			if (at(s->file(),s->rank()) == value)
-				return s;
-		}
-		return ss.cend();	
+		const square_mask_t found = mask_of(value) & ss.mask();
+		if (found == 0)
+			return ss.cend();
+		return ss.find(Square::from_index(lowest_index(found)));
 	}
 
 	void Board::apply(std::function<void (Square, Piece)> fn) const {
@@ -66,27 +115,25 @@ namespace arti {
 
 
 	int Board::count_repeats(const Region& ss, const Piece &value) const {
+		const square_mask_t found = mask_of(value) & ss.mask();
 		int result = 0;
-		bool repeating = false;
 		int count = 0;
-		for (auto s = ss.cbegin(); s != ss.cend(); s++)
-			if (at(s->file(),s->rank()) == value) {
-				if (repeating)
-					count++;
-				else
-					count = 1;
+		// walk the squares of ss in order; a square not in found ends the sequence
+		for (square_mask_t rest = ss.mask(); rest != 0; rest &= rest - 1) {
+			if (found & rest & (~rest + 1)) {
+				count++;
 				if (count > result)
 					result = count;
-				repeating = true;
 			} else
-				repeating = false;
+				count = 0;
+		}
 		return result;	
 	}
 
 	bool Board::operator<(const Board& o) const {
 		for (size_t i = 0; i < _data.size(); i++ )
-			if (_data[i] < o._data[i])
-				return true;
+			if (_data[i] != o._data[i])
+				return _data[i] < o._data[i];
 		return false;	
 	}
 
@@ -46,7 +46,7 @@ namespace arti {
 			 * Signifies that the square has no value.
 			 */
 			const static Piece OUT_OF_BOUNDS;
-			explicit Piece(square_value_t v = EMPTY._value);
+			explicit Piece(square_value_t v = EMPTY._value) : _value(v) {}
 			bool is_empty() const {return _value == EMPTY._value;}
 			bool is_piece() const {return _value != EMPTY._value;}	;
 			bool is_out_of_bounds() const {return _value == OUT_OF_BOUNDS._value;}			;
@@ -73,21 +73,35 @@ namespace arti {
 	/**
 	 * An 8x8 matrix of Piece objects.
 	 * Left bottom square is (0,0), and right top is (7,7).
+	 *
+	 * Next to the squares, the board keeps an occupancy mask for each of the
+	 * first tracked_pieces (non-empty) piece values that are placed on it. Games such as
+	 * Connect4 and tic-tac-toe stay within that limit, so counting their pieces is
+	 * a popcount.  Pieces beyond the limit are found by looking at the squares.
+	 * Boards are plain values; a copy is a memcpy.
+	 *
+	 * The board also keeps a Zobrist hash of its squares; place() updates it.
 	 */
 	class Board {
 		public:
+			typedef std::uint64_t hash_t;
+			/** The number of piece values that get an occupancy mask */
+			static const int tracked_pieces = 4;
 			/**
 			 * Construct an instance that contains a Piece#EMPTY in each square.
 			 */
 			Board();
-			Board(const Board& b);
 			/**
 			 * What is on a square?
 			 * @param colIndex
 			 * @param rowIndex
 			 * @return Piece::OUT_OF_BOUNDS if indexes are invalid
 			 */
-			const Piece& at(const index_t colIndex,const index_t rowIndex) const;
+			const Piece& at(const index_t colIndex,const index_t rowIndex) const {
+				if (colIndex > 7 || rowIndex > 7)
+					return Piece::OUT_OF_BOUNDS;
+				return _data[rowIndex * 8 + colIndex];
+			}
 			const Piece& operator ()(const index_t colIndex,const index_t rowIndex) const {return at(colIndex,rowIndex);}
 			const Piece& operator ()(const Square& s) const {return at(s.file(),s.rank());}
 			/**
@@ -100,12 +114,21 @@ namespace arti {
 			void operator()(const std::size_t colIndex, const std::size_t rowIndex,const Piece &value) {place(colIndex,rowIndex,value);}
 			void operator()(const Square& s, const Piece &value) {place(s.file(),s.rank(),value);}
 			void operator()(const Region& ss, const Piece &value); 
+			/** The squares that contain value */
+			square_mask_t mask_of(const Piece &value) const;
 			int count(const Region& ss, const Piece &value) const;
 			/** Max of value sequence length */
 			int count_repeats(const Region& ss, const Piece &value) const;
 			/** Return cend() if not found */
 			Region::const_iterator find(const Region& ss, const Piece &value) const;
+			/** Lexicographic on the squares */
 			bool operator< (const Board& o) const;
+			bool operator== (const Board& o) const {return _hash == o._hash && _data == o._data;}
+			bool operator!= (const Board& o) const {return !operator==(o);}
+			/** The Zobrist hash of the squares; equal boards have equal hashes. An empty board hashes to 0. */
+			hash_t hash() const {return _hash;}
+			/** The value that a Piece on a square contributes to hash() */
+			static hash_t hash_of(const ordinal_t squareIndex, const Piece &value);
 			class const_iterator : public std::iterator<std::forward_iterator_tag,Square> {
 					ordinal_t _file,_rank;
 					const Board * _b;
@@ -134,8 +157,14 @@ namespace arti {
 			const const_iterator end() const {return const_iterator(this,7,7);}
 			void apply(std::function<void (Square, Piece)> fn) const;
 		private:
+			/** Sets m to the squares of value, if that can be done without looking at the squares */
+			bool tracked_mask(const Piece &value, square_mask_t &m) const;
+			square_mask_t _masks[tracked_pieces]; // _masks[i] is the occupancy of _tracked[i]
+			hash_t _hash;
 			std::array<Piece, 64> _data;
-			const_iterator _it_b, _it_e;
+			Piece _tracked[tracked_pieces];
+			unsigned char _tracked_count;
+			bool _untracked; // a piece value without a mask has been placed
 		public:
 			typedef std::unique_ptr<Board> u_ptr;
 			typedef std::list<std::unique_ptr<Board>> u_ptr_list;
@@ -180,3 +209,10 @@ namespace arti {
 
 	
 }
+
+namespace std {
+	/** Lets a Board be the key of unordered containers */
+	template<> struct hash<arti::Board> {
+		size_t operator()(const arti::Board& b) const {return (size_t) b.hash();}
+	};
+}
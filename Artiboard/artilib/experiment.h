@@ -15,6 +15,7 @@ namespace arti {
 		public:
 			void reset(int argc, char * argv[]);
 			const std::string& operator[](const std::string& k) const;
+			bool contains(const std::string& k) const {return values_.count(k) > 0;}
 	};
 	/**
 	 * When an experiment is created, it is registered
@@ -0,0 +1,187 @@
+#include <tuple>
+#include <algorithm>
+#include <sstream>
+#include "feat_code.h"
+
+namespace arti {
+
+	namespace {
+		const std::size_t batch_size = 64;
+		const std::size_t local_words = 128;
+	}
+
+	bool FeatureCode::Instruction::operator< (const Instruction &o) const {
+		return std::tie(op, a, b, region) < std::tie(o.op, o.a, o.b, o.region);
+	}
+
+	FeatureCode::FeatureCode(const FeatureProgram &program, const state_pieces_t &states) {
+		for (auto &e : program.formulas()) {
+			const std::uint32_t result = compile(*e.second, program, states);
+			formulas_.push_back({e.first, result, code_of({result})});
+		}
+		for (auto &e : program.functions()) {
+			Function f = {e.first, 0.0f, {}, {}};
+			std::vector<std::uint32_t> results;
+			for (auto &t : e.second->terms()) {
+				if (auto ft = dynamic_cast<const FeatureTermWithFormula*>(t.get()))
+					f.terms.push_back({t->weight(), formulas_[formula_index(ft->formula_name())].result});
+				else if (auto et = dynamic_cast<const FeatureTermWithExpression*>(t.get()))
+					f.terms.push_back({t->weight(), compile(et->expression(), program, states)});
+				else
+					f.constant += t->weight();
+			}
+			for (auto &t : f.terms)
+				results.push_back(t.second);
+			f.code = code_of(results);
+			functions_.push_back(f);
+		}
+	}
+
+	std::uint32_t FeatureCode::compile(const FeatureExpression &e, const FeatureProgram &program, const state_pieces_t &states) {
+		if (auto g = dynamic_cast<const GroundExpression*>(&e)) {
+			program.states().check_name(g->_stateset);
+			program.regions().check_name(g->_region);
+			auto s = stateset_ids_.find(g->_stateset);
+			if (s == stateset_ids_.end()) {
+				std::vector<Piece> pieces;
+				for (auto &state : program.states().at(g->_stateset)) {
+					auto p = states.find(state);
+					if (p != states.end())
+						pieces.insert(pieces.end(), p->second.begin(), p->second.end());
+					else if (state.size() == 1)
+						pieces.push_back(Piece(state[0]));
+					else
+						throw runtime_error_ex("The state '%s' has no pieces", state.c_str());
+				}
+				s = stateset_ids_.insert({g->_stateset, (std::uint32_t) statesets_.size()}).first;
+				statesets_.push_back(pieces);
+			}
+			return add({Ground, s->second, 0, program.regions().at(g->_region).mask()});
+		}
+		if (auto n = dynamic_cast<const NotExpression*>(&e))
+			return add({Not, compile(n->other(), program, states), 0, 0});
+		if (auto b = dynamic_cast<const BinaryExpression*>(&e)) {
+			const std::uint32_t e1 = compile(b->e1(), program, states);
+			const std::uint32_t e2 = compile(b->e2(), program, states);
+			// both are commutative, so the operands are ordered to share more instructions
+			const Op op = dynamic_cast<const AndExpression*>(b) ? And : Or;
+			return add({op, std::min(e1, e2), std::max(e1, e2), 0});
+		}
+		std::stringstream ss;
+		ss << e;
+		throw runtime_error_ex("The expression '%s' cannot be compiled", ss.str().c_str());
+	}
+
+	std::uint32_t FeatureCode::add(const Instruction &i) {
+		auto found = instruction_ids_.find(i);
+		if (found != instruction_ids_.end())
+			return found->second;
+		const std::uint32_t result = instructions_.size();
+		instructions_.push_back(i);
+		instruction_ids_[i] = result;
+		return result;
+	}
+
+	FeatureCode::code_t FeatureCode::code_of(const std::vector<std::uint32_t> &results) const {
+		// the operands of an instruction come before it
+		std::vector<bool> needed(instructions_.size(), false);
+		for (auto r : results)
+			needed[r] = true;
+		for (std::size_t i = instructions_.size(); i-- > 0;)
+			if (needed[i]) {
+				const Instruction &in = instructions_[i];
+				if (in.op != Ground) needed[in.a] = true;
+				if (in.op == And || in.op == Or) needed[in.b] = true;
+			}
+		code_t result;
+		for (std::size_t i = 0; i < needed.size(); i++)
+			if (needed[i]) result.push_back(i);
+		return result;
+	}
+
+	void FeatureCode::run(const code_t &code, const Board *boards, const std::size_t count, std::uint64_t *words) const {
+		for (auto i : code) {
+			const Instruction &in = instructions_[i];
+			switch (in.op) {
+			case Ground: {
+				const std::vector<Piece> &pieces = statesets_[in.a];
+				std::uint64_t w = 0;
+				for (std::size_t j = 0; j < count; j++) {
+					square_mask_t m = 0;
+					for (auto &p : pieces)
+						m |= boards[j].mask_of(p);
+					if ((m & in.region) == in.region)
+						w |= std::uint64_t(1) << j;
+				}
+				words[i] = w;
+				break;
+			}
+			case And: words[i] = words[in.a] & words[in.b]; break;
+			case Or: words[i] = words[in.a] | words[in.b]; break;
+			case Not: words[i] = ~words[in.a]; break;
+			}
+		}
+	}
+
+	std::size_t FeatureCode::formula_index(const string &name) const {
+		for (std::size_t f = 0; f < formulas_.size(); f++)
+			if (formulas_[f].name == name) return f;
+		throw runtime_error_ex("The formula '%s' cannot be found", name.c_str());
+	}
+
+	std::size_t FeatureCode::function_index(const string &name) const {
+		for (std::size_t f = 0; f < functions_.size(); f++)
+			if (functions_[f].name == name) return f;
+		throw runtime_error_ex("The function '%s' cannot be found", name.c_str());
+	}
+
+	bool FeatureCode::holds(const std::size_t f, const Board &b) const {
+		bool result;
+		holds(f, &b, 1, &result);
+		return result;
+	}
+
+	void FeatureCode::holds(const std::size_t f, const Board *boards, const std::size_t count, bool *result) const {
+		// most programs fit in the words on the stack
+		std::uint64_t local[local_words];
+		std::vector<std::uint64_t> heap(instructions_.size() > local_words ? instructions_.size() : 0);
+		std::uint64_t * words = heap.empty() ? local : heap.data();
+		const Formula &formula = formulas_[f];
+		for (std::size_t first = 0; first < count; first += batch_size) {
+			const std::size_t n = std::min(batch_size, count - first);
+			run(formula.code, boards + first, n, words);
+			for (std::size_t j = 0; j < n; j++)
+				result[first + j] = (words[formula.result] >> j) & 1;
+		}
+	}
+
+	float FeatureCode::value(const std::size_t f, const Board &b) const {
+		float result;
+		values(f, &b, 1, &result);
+		return result;
+	}
+
+	void FeatureCode::values(const std::size_t f, const Board *boards, const std::size_t count, float *result) const {
+		std::uint64_t local[local_words];
+		std::vector<std::uint64_t> heap(instructions_.size() > local_words ? instructions_.size() : 0);
+		std::uint64_t * words = heap.empty() ? local : heap.data();
+		const Function &function = functions_[f];
+		for (std::size_t first = 0; first < count; first += batch_size) {
+			const std::size_t n = std::min(batch_size, count - first);
+			run(function.code, boards + first, n, words);
+			for (std::size_t j = 0; j < n; j++)
+				result[first + j] = function.constant;
+			for (auto &t : function.terms) {
+				const std::uint64_t w = words[t.second];
+				for (std::size_t j = 0; j < n; j++)
+					if ((w >> j) & 1) result[first + j] += t.first;
+			}
+		}
+	}
+
+	eval_function_t FeatureCode::eval_function(const string &name) const {
+		const std::size_t f = function_index(name);
+		return [this, f](const Position &pos) {return value(f, pos.board());};
+	}
+
+}
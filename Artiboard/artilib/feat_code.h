@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+#include "feat_program.h"
+#include "game.h"
+#include "outcomedata.h"
+
+namespace arti {
+
+	/**
+	 * A FeatureProgram compiled for evaluation.  The names are resolved once: every stateset becomes
+	 * the pieces of its states and every region the mask of its squares.  The formulas become one list
+	 * of instructions, in which equal subexpressions share an instruction, and every function the
+	 * weighted sum of the instructions of its terms.
+	 *
+	 * The formula s@r holds if every square of region r has a piece of one of the states of s.
+	 *
+	 * Boards are evaluated 64 at a time: the result of an instruction is a word with a bit per board,
+	 * so that a formula is a few word operations for all of them.
+	 */
+	class FeatureCode {
+		PREVENT_COPY(FeatureCode)
+	public:
+		typedef std::map<string, std::vector<Piece>> state_pieces_t;
+		/** a state that is not in states is the piece of its name, which has one character */
+		FeatureCode(const FeatureProgram &program, const state_pieces_t &states = state_pieces_t());
+		std::size_t formula_count() const {return formulas_.size();}
+		const string& formula_name(const std::size_t f) const {return formulas_[f].name;}
+		std::size_t formula_index(const string &name) const;
+		std::size_t function_count() const {return functions_.size();}
+		const string& function_name(const std::size_t f) const {return functions_[f].name;}
+		std::size_t function_index(const string &name) const;
+		/** formula f holds on b */
+		bool holds(const std::size_t f, const Board &b) const;
+		/** result[i] is holds(f, boards[i]) */
+		void holds(const std::size_t f, const Board *boards, const std::size_t count, bool *result) const;
+		/** function f of b */
+		float value(const std::size_t f, const Board &b) const;
+		/** result[i] is value(f, boards[i]) */
+		void values(const std::size_t f, const Board *boards, const std::size_t count, float *result) const;
+		/** function name of the board of a position; the function refers to this instance */
+		eval_function_t eval_function(const string &name) const;
+	private:
+		enum Op {Ground, And, Or, Not};
+		struct Instruction {
+			Op op;
+			std::uint32_t a, b;    // the stateset of Ground, or the instructions of the others
+			square_mask_t region;  // of Ground
+			bool operator< (const Instruction &o) const;
+		};
+		/** the instructions that a result needs, in order */
+		typedef std::vector<std::uint32_t> code_t;
+		struct Formula {
+			string name;
+			std::uint32_t result;
+			code_t code;
+		};
+		struct Function {
+			string name;
+			float constant;
+			std::vector<std::pair<float, std::uint32_t>> terms;
+			code_t code;
+		};
+		std::uint32_t compile(const FeatureExpression &e, const FeatureProgram &program, const state_pieces_t &states);
+		std::uint32_t add(const Instruction &i);
+		code_t code_of(const std::vector<std::uint32_t> &results) const;
+		/** runs code on up to 64 boards into words */
+		void run(const code_t &code, const Board *boards, const std::size_t count, std::uint64_t *words) const;
+		std::vector<std::vector<Piece>> statesets_;
+		std::map<string, std::uint32_t> stateset_ids_;
+		std::vector<Instruction> instructions_;
+		std::map<Instruction, std::uint32_t> instruction_ids_;
+		std::vector<Formula> formulas_;
+		std::vector<Function> functions_;
+	};
+
+	/** The formulas of a FeatureCode as attributes with the values N and Y */
+	class FormulaEncoder : public DataTableEncoder {
+	public:
+		FormulaEncoder(const FeatureCode &code) : code_(code) {}
+		int value_of(const Board &b, const size_t a) const override {return code_.holds(a, b) ? 1 : 0;}
+		int attribute_count() const override {return code_.formula_count();}
+		std::string attribute_name(const size_t a) const override {return code_.formula_name(a);}
+		std::string value_name(const size_t a, const size_t v) const override {return (v == 1) ? "Y" : "N";}
+	private:
+		const FeatureCode &code_;
+	};
+
+}
@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <list>
+#include <sstream>
 #include "systemex.h"
 #include "board.h"
 #include "square.h"
@@ -19,7 +20,7 @@ namespace arti {
 		void check_name(const string& name) const {
 			if (!has_name(name)) {
 				std::stringstream ss;
-				ss << "The name '" << name << "' cannot be found. Use one of " << size() << " names:" ; 
+				ss << "The name '" << name << "' cannot be found. Use one of " << baseT::size() << " names:" ; 
 				for (auto &e : *this) ss << " " << e.first;
 				throw std::runtime_error(ss.str());
 			}
@@ -78,6 +79,7 @@ namespace arti {
 	class NotExpression : public UnaryExpression {
 	public:
 		NotExpression(FeatureExpression* o) : UnaryExpression(o) {}
+		const FeatureExpression& other() const {return *_other;}
 		void to_stream(std::ostream& os) const override {os << "!(" << *_other << ")";}
 	};
 
@@ -85,6 +87,9 @@ namespace arti {
 	class BinaryExpression : public FeatureExpression {
 	protected:
 		BinaryExpression(FeatureExpression* e1, FeatureExpression* e2): _e1(e1), _e2(e2) {}
+	public:
+		const FeatureExpression& e1() const {return *_e1;}
+		const FeatureExpression& e2() const {return *_e2;}
 	protected:	
 		const FeatureExpression_u_ptr _e1;
 		const FeatureExpression_u_ptr _e2;
@@ -126,6 +131,7 @@ namespace arti {
 	public:
 		FeatureTermWithFormula(float weight, const string& formula_name) : FeatureTerm(weight), _formula_name(formula_name) {}
 		void to_stream(std::ostream& os) const override {os << _weight << "*" << _formula_name;}
+		const string& formula_name() const {return _formula_name;}
 	private:
 		const string _formula_name;
 	};
@@ -134,6 +140,7 @@ namespace arti {
 	public:
 		FeatureTermWithExpression(float weight, FeatureExpression * e) : FeatureTerm(weight),_e(e) {}
 		void to_stream(std::ostream& os) const override {os << _weight << "*" << *_e;}
+		const FeatureExpression& expression() const {return *_e;}
 	private:
 		FeatureExpression_u_ptr _e;
 	};
@@ -142,6 +149,7 @@ namespace arti {
 	public:
 		FeatureFunction():_terms() {};
 		std::list<upFeatureTerm>& terms() {return _terms;}
+		const std::list<upFeatureTerm>& terms() const {return _terms;}
 		void to_stream(std::ostream& os) const override;
 	private:
 		std::list<upFeatureTerm> _terms;
@@ -153,10 +161,13 @@ namespace arti {
 		FeatureProgram() {};
 		typedef std::unique_ptr<FeatureProgram> u_ptr;
 		NameMap<StateSet>& states() {return _stateMap;}
+		const NameMap<StateSet>& states() const {return _stateMap;}
 		NameMap<Region>& regions() {return _regionMap;}
 		const NameMap<Region>& regions() const {return _regionMap;}
 		NameMap<FeatureExpression*>& formulas() {return _formulaMap;}
+		const NameMap<FeatureExpression*>& formulas() const {return _formulaMap;}
 		NameMap<FeatureFunction*>& functions() {return _functionMap;}
+		const NameMap<FeatureFunction*>& functions() const {return _functionMap;}
 		~FeatureProgram();
 	private:
 		NameMap<StateSet> _stateMap;	
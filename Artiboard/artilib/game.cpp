@@ -1,6 +1,5 @@
 #include "game.h"
 #include "systemex.h"
-#include <random>
 #include <math.h>
 #include "log.h"
 #define FOR_SQUARES(row,col) for (index_t row = 0; row < 8; row++) for (index_t col = 0; col < 8; col++)
@@ -20,6 +19,14 @@ namespace arti {
 	}
 
 
+	void Move::add(shared_ptr<Step>& step) {
+		// the steps are applied in the order they were added
+		auto last = _steps.before_begin();
+		for (auto it = _steps.begin(); it != _steps.end(); it++)
+			last = it;
+		_steps.insert_after(last, step);
+	}
+
 	std::unique_ptr<Board> GameSpecification::initialBoard() const {
 		auto result = new Board();
 		setup(*result);
@@ -42,6 +49,23 @@ namespace arti {
 	}
 
 
+	int GameSpecification::collect_moves(const Position& pos, CompactMove * moves) const {
+		Board::u_ptr_list boards;
+		collectBoards(pos, boards);
+		int n = 0;
+		for (auto &b : boards) {
+			ENSURE(n < max_moves, "too many moves for the move buffer");
+			// the squares that differ, so that moves, captures and passes are found too
+			moves[n].count = 0;
+			for (ordinal_t i = 0; i < 64; i++) {
+				const Square s = Square::from_index(i);
+				if (pos.board()(s) != (*b)(s))
+					moves[n].place(i, (*b)(s));
+			}
+			n++;
+		}
+		return n;
+	}
 
 	void GameSpecificationWithLocalSteps::collectMoves(const Position& pos, Move::SharedFWList &result) const {
 		BoardView view(pos.board(),pos.ply().side_to_move());
@@ -140,9 +164,6 @@ namespace arti {
 
 
  Board::u_ptr_it PickRandom::select(const Position & current,Board::u_ptr_list &children) {
-	 static std::default_random_engine engine;
-	 static std::uniform_real_distribution<float> distro(0.0f,1.0f);
-	 static auto random = std::bind(distro,engine);
 	 // if there is a winning move, take it
 	 for (auto b = children.begin(); b!= children.end(); b++) {
 		 PositionThatPoints p(current.ply().next(),b->get());
@@ -152,7 +173,7 @@ namespace arti {
 		 if (oc == NorthPlayerWins && current.ply().is_player_b())
 			 return b;
 	 }
-	 const int count = (int) std::round((children.size()+1) * random() - 0.5f);
+	 const int count = (int) std::round((children.size()+1) * distro_(engine_) - 0.5f);
 	 //TRACE << children.size() << " " << count;
 	 auto it = children.begin();
 	 // advance to (i+1)-th child
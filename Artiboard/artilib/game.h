@@ -1,6 +1,7 @@
 #pragma once
 #include "board.h"
 #include "systemex.h"
+#include <random>
 namespace arti {
 	/**
 	 * A level in the game tree, there are two plies for a move.
@@ -122,6 +123,28 @@ namespace arti {
 
 	ostream& operator <<(std::ostream& os, const PositionThatOwns& v);
 
+	/**
+	 * A move as the pieces that it places, on at most max_changes squares; a pass places none.
+	 * It is small enough to be kept in a fixed buffer and applied in place; make_move records the
+	 * pieces that it replaced so that unmake_move can restore the board.
+	 */
+	struct CompactMove {
+		static const int max_changes = 8;
+		/** the move places piece on square and nothing else */
+		void set(const ordinal_t square, const Piece &piece) {count = 0; place(square, piece);}
+		/** the move also places piece on square */
+		void place(const ordinal_t square, const Piece &piece) {
+			ENSURE(count < max_changes, "a move changes too many squares");
+			squares[count] = square;
+			pieces[count] = piece.index();
+			count++;
+		}
+		unsigned char count;
+		ordinal_t squares[max_changes]; // Square::index()
+		square_value_t pieces[max_changes];
+		square_value_t replaced[max_changes];
+	};
+
 	enum MatchOutcome {
 		Unknown, SouthPlayerWins, NorthPlayerWins, Draw
 	};
@@ -147,6 +170,29 @@ namespace arti {
 			/* Add next Boards to result, return the number of Boards appended */
 			int collectBoards(const Position& pos, Board::u_ptr_list &result) const;
 			virtual MatchOutcome outcome_of(const Position& pos) const = 0;
+			/** The most moves that collect_moves will write */
+			static const int max_moves = 64;
+			/**
+			 * Write the moves possible from pos into moves (room for max_moves) and return their count.
+			 * The moves are in the same order as the Boards of collectBoards, so a position always
+			 * gives them in the same order and a transposition table can keep the index of one.
+			 * The default derives them from collectBoards, so games should override it to avoid
+			 * allocation; it fails for moves that change more than CompactMove::max_changes squares.
+			 */
+			virtual int collect_moves(const Position& pos, CompactMove * moves) const;
+			/** Apply m on board in place */
+			void make_move(Board& board, CompactMove& m) const {
+				for (int i = 0; i < m.count; i++) {
+					const Square s = Square::from_index(m.squares[i]);
+					m.replaced[i] = board(s).index();
+					board(s, Piece(m.pieces[i]));
+				}
+			}
+			/** Undo make_move(board,m) */
+			void unmake_move(Board& board, const CompactMove& m) const {
+				for (int i = m.count; i-- > 0;)
+					board(Square::from_index(m.squares[i]), Piece(m.replaced[i]));
+			}
 			virtual ~GameSpecification() {};
 		protected:
 			/**
@@ -211,11 +257,18 @@ namespace arti {
 			;
 	};
 
+	/**
+	 * Takes a winning move if there is one, otherwise any move.
+	 * Every instance has its own random engine, so give each thread its own PickRandom.
+	 */
 	class PickRandom: public MoveChooser {
 		private:
 			const GameSpecification& spec_;
+			std::default_random_engine engine_;
+			std::uniform_real_distribution<float> distro_;
 		public:
-			PickRandom(const GameSpecification& spec): spec_(spec){}
+			PickRandom(const GameSpecification& spec, const unsigned seed = std::default_random_engine::default_seed)
+				: spec_(spec), engine_(seed), distro_(0.0f,1.0f) {}
 		  /** Choose any child in the list of children */
 			Board::u_ptr_it select(const Position & current,Board::u_ptr_list &children) override;
 	};
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include "icureader.h"
+
+namespace arti {
+
+namespace {
+	bool is_blank(const char c) {return c == ' ' || c == '\t' || c == '\r';}
+
+	const char * line_end(const char *p, const char *end) {
+		const char * e = (const char *) memchr(p, '\n', end - p);
+		return e ? e : end;
+	}
+
+	/** the first value of the line, or its end if the line is blank */
+	const char * first_value(const char *p, const char *end) {
+		while (p < end && is_blank(*p)) p++;
+		return p;
+	}
+
+	std::size_t count_rows(const char *p, const char *end) {
+		std::size_t result = 0;
+		while (p < end) {
+			const char * e = line_end(p, end);
+			if (first_value(p, e) < e) result++;
+			p = e + 1;
+		}
+		return result;
+	}
+}
+
+IcuReader::IcuReader(const IcuFormat &format, const bool detect_duplicates, const unsigned threads) :
+	format_(format), detect_duplicates_(detect_duplicates),
+	threads_(threads == 0 ? std::max(1U, std::thread::hardware_concurrency()) : threads), duplicates_(0) {
+	ENSURE(format.files <= 8 && format.ranks <= 8, "a board has at most 8 files and 8 ranks");
+}
+
+outcome_rows_t IcuReader::read(const std::string &file_name) {
+	const MappedFile file(file_name);
+	return parse(file.begin(), file.end());
+}
+
+outcome_rows_t IcuReader::parse(const char *begin, const char *end) {
+	// range k starts at the first line that starts at or after begin + k*size/n
+	const std::size_t n = std::max<std::size_t>(1, std::min<std::size_t>(threads_, (end - begin) / 4096 + 1));
+	std::vector<const char *> starts(n + 1, end);
+	starts[0] = begin;
+	for (std::size_t k = 1; k < n; k++) {
+		const char * p = std::max(starts[k - 1], begin + k * (end - begin) / n);
+		starts[k] = p == begin || p[-1] == '\n' ? p : std::min(end, line_end(p, end) + 1);
+	}
+	auto in_ranges = [&](std::function<void (const std::size_t k)> fn) {
+		std::vector<std::future<void>> futures;
+		for (std::size_t k = 1; k < n; k++)
+			futures.push_back(std::async(std::launch::async, fn, k));
+		fn(0);
+		for (auto &f : futures)
+			f.get();
+	};
+	// the rows of range k start at first[k]
+	std::vector<std::size_t> first(n + 1, 0);
+	in_ranges([&](const std::size_t k) {first[k + 1] = count_rows(starts[k], starts[k + 1]);});
+	for (std::size_t k = 0; k < n; k++)
+		first[k + 1] += first[k];
+	outcome_rows_t result(first[n]);
+	in_ranges([&](const std::size_t k) {
+		std::size_t index = first[k];
+		const char * p = starts[k];
+		while (p < starts[k + 1]) {
+			const char * e = line_end(p, starts[k + 1]);
+			const char * v = first_value(p, e);
+			if (v < e) {
+				parse_row(v, e, result[index], index);
+				index++;
+			}
+			p = e + 1;
+		}
+	});
+	duplicates_ = 0;
+	if (detect_duplicates_)
+		remove_duplicates(result);
+	return result;
+}
+
+void IcuReader::parse_row(const char *p, const char *end, OutcomeRow &row, const std::size_t index) const {
+	for (std::size_t i = 0; i < format_.files; i++)
+		for (std::size_t j = 0; j < format_.ranks; j++) {
+			if (end - p < 2 || p[1] != ',')
+				throw runtime_error_ex("row %d has no value for square %d,%d", (int) index + 1, (int) i, (int) j);
+			row.board.place(i, j, Piece(format_.blank && *p == format_.blank ? format_.blank_piece : *p));
+			p += 2;
+		}
+	const char * e = p;
+	while (e < end && *e != ',' && !is_blank(*e)) e++;
+	row.outcome = format_.otherwise;
+	for (const auto &o : format_.outcomes)
+		if (o.first.size() == (std::size_t) (e - p) && std::equal(p, e, o.first.begin()))
+			row.outcome = o.second;
+}
+
+void IcuReader::remove_duplicates(outcome_rows_t &rows) {
+	// sort the indexes by board, earlier rows first, and keep the first index of every board
+	std::vector<uint32_t> order(rows.size());
+	for (std::size_t i = 0; i < order.size(); i++)
+		order[i] = (uint32_t) i;
+	std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) {return rows[a].board < rows[b].board;});
+	std::vector<bool> keep(rows.size(), true);
+	for (std::size_t i = 1; i < order.size(); i++)
+		if (rows[order[i]].board == rows[order[i - 1]].board)
+			keep[order[i]] = false;
+	std::size_t kept = 0;
+	for (std::size_t i = 0; i < rows.size(); i++)
+		if (keep[i])
+			rows[kept++] = rows[i];
+	duplicates_ = rows.size() - kept;
+	rows.resize(kept);
+}
+
+}
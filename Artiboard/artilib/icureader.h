@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include "outcomedata.h"
+
+namespace arti {
+
+/**
+ * The layout of a data file of the UCI machine learning repository, such as connect-4.data and
+ * tic-tac-toe.data: one row per line, the value of every square as one character followed by a
+ * comma, file by file, and then the name of the outcome.
+ */
+struct IcuFormat {
+	std::size_t files;
+	std::size_t ranks;
+	char blank;       // the value that is read as blank_piece; 0 if every value is read as is
+	char blank_piece;
+	std::vector<std::pair<std::string,MatchOutcome>> outcomes;
+	MatchOutcome otherwise; // the outcome of a name that is not in outcomes
+};
+
+/**
+ * Reads the rows of a UCI data file into one preallocated vector.
+ *
+ * The file is mapped into memory and split into ranges of lines, one per thread.  Every thread
+ * counts the rows of its range, so that the threads then parse straight into their own part of
+ * the result.  Duplicate detection removes every row whose board is on an earlier row.
+ */
+class IcuReader {
+	PREVENT_COPY(IcuReader)
+	public:
+		/** threads 0 is one per core */
+		explicit IcuReader(const IcuFormat &format, const bool detect_duplicates = false, const unsigned threads = 0);
+		outcome_rows_t read(const std::string &file_name);
+		outcome_rows_t parse(const char *begin, const char *end);
+		/** the rows that the last read or parse removed */
+		std::size_t duplicates() const {return duplicates_;}
+	private:
+		void parse_row(const char *p, const char *end, OutcomeRow &row, const std::size_t index) const;
+		void remove_duplicates(outcome_rows_t &rows);
+		const IcuFormat format_;
+		const bool detect_duplicates_;
+		const unsigned threads_;
+		std::size_t duplicates_;
+};
+
+}
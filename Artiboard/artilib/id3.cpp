@@ -1,11 +1,14 @@
 #include <iterator>
-#include "id3.h"
-#ifndef _MSC_BUILD
-std::default_random_engine generator;
-#else
-#include <random>
-std::random_device generator;
+#include <future>
+#include <thread>
+#include <mutex>
+#include <unordered_set>
+#include <cmath>
+#ifdef __AVX2__
+#include <immintrin.h>
 #endif
+#include "id3.h"
+#include "square.h"
 
 namespace {
 	void fill(std::forward_list<size_t>& list, const size_t count) {
@@ -22,10 +25,539 @@ namespace {
 		}
 	}
 
-	float log2(const float v) {
-		const float lg = std::log(2.0f);
-		return std::log(v) / lg;
+	/* the number of bits that are set in a[i] & b[i] for i in [0,n) */
+	int and_count(const uint64_t * a, const uint64_t * b, const size_t n) {
+		size_t i = 0;
+		int result = 0;
+#ifdef __AVX2__
+		// the bits of each nibble are looked up with a shuffle and the bytes are summed with sad
+		const __m256i lookup = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+		const __m256i low = _mm256_set1_epi8(0x0f);
+		__m256i sums = _mm256_setzero_si256();
+		for (; i + 4 <= n; i += 4) {
+			const __m256i v = _mm256_and_si256(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+			const __m256i bits = _mm256_add_epi8(
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+			sums = _mm256_add_epi64(sums, _mm256_sad_epu8(bits, _mm256_setzero_si256()));
+		}
+		uint64_t lanes[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+		result = (int) (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+#endif
+		for (; i < n; i++)
+			result += arti::popcount(a[i] & b[i]);
+		return result;
+	}
+
+	/* counts[v * class_limit + c] is the number of elements in index[first,last) with value v and class c */
+	void count_range(const arti::AttributeMatrix &m, const size_t attribute, const uint32_t * index, const size_t first, const size_t last,
+		std::vector<int> &counts) {
+		const uint8_t * column = m.column(attribute);
+		const uint8_t * classes = m.classes();
+		const int class_limit = m.class_limit();
+		counts.assign(m.value_limit(attribute) * class_limit, 0);
+		for (size_t i = first; i < last; i++) {
+			const uint32_t e = index[i];
+			counts[column[e] * class_limit + classes[e]]++;
+		}
+	}
+
+	/*
+	 * A stable counting sort of index[first,last) by value; the elements with value v end up in
+	 * [bounds[v],bounds[v+1]).  counts are those of count_range
+	 */
+	void split_range(const arti::AttributeMatrix &m, const size_t attribute, uint32_t * index, const size_t first, const size_t last,
+		const std::vector<int> &counts, std::vector<size_t> &bounds, std::vector<uint32_t> &scratch) {
+		const int values = m.value_limit(attribute);
+		const int class_limit = m.class_limit();
+		bounds.assign(1, first);
+		for (int v = 0; v < values; v++) {
+			size_t next = bounds.back();
+			for (int c = 0; c < class_limit; c++)
+				next += counts[v * class_limit + c];
+			bounds.push_back(next);
+		}
+		std::vector<size_t> next(bounds.begin(), bounds.end() - 1);
+		scratch.resize(last - first);
+		const uint8_t * column = m.column(attribute);
+		for (size_t i = first; i < last; i++)
+			scratch[next[column[index[i]]]++ - first] = index[i];
+		std::copy(scratch.begin(), scratch.begin() + (last - first), index + first);
 	}
+
+	/**
+	 * The elements of a node as the range [first,last) of one index vector.  Splitting a node
+	 * partitions its range in place, so different subtrees (and the tasks that build them) never
+	 * share elements.
+	 */
+	class IndexSubsets {
+		public:
+			typedef std::pair<size_t,size_t> subset_t;
+			IndexSubsets(const arti::AttributeMatrix &m, std::vector<uint32_t> &index) : matrix_(m), index_(index) {}
+			subset_t root() const {return subset_t(0, index_.size());}
+			static size_t size(const subset_t &s) {return s.second - s.first;}
+			void count(const size_t attribute, const subset_t &s, std::vector<int> &counts) const {
+				count_range(matrix_, attribute, index_.data(), s.first, s.second, counts);
+			}
+			/* children[v] gets the elements with value v */
+			void split(const size_t attribute, const subset_t &s, const std::vector<int> &counts, std::vector<subset_t> &children) const {
+				static thread_local std::vector<uint32_t> scratch;
+				std::vector<size_t> bounds;
+				split_range(matrix_, attribute, index_.data(), s.first, s.second, counts, bounds, scratch);
+				for (size_t v = 0; v + 1 < bounds.size(); v++)
+					children.push_back(subset_t(bounds[v], bounds[v + 1]));
+			}
+		private:
+			const arti::AttributeMatrix &matrix_;
+			std::vector<uint32_t> &index_;
+	};
+
+	/**
+	 * The elements of a node as one bitset over all elements for each class.  Every value of every
+	 * attribute is a bitset too, so counting the elements with a value and a class is an AND and a popcount;
+	 * the last value that occurs is counted by subtracting the others from the class size.
+	 *
+	 * The cost of a bitset is the range of words that its elements span, and in the lower nodes that
+	 * range is mostly empty.  A node with fewer than sparse_factor elements per word in its range
+	 * lists its elements in an index vector instead, which its subtree splits like IndexSubsets does.
+	 */
+	class BitSubsets {
+		public:
+			static const size_t sparse_factor = 8;
+			struct Bits {
+				size_t lo, hi; // only the words [lo,hi) can have bits set
+				std::vector<std::vector<uint64_t>> classes; // the words [lo,hi) of the elements of each class
+				std::vector<int> class_sizes;
+				size_t size;
+			};
+			/* either bits, or the range [first,last) of index */
+			struct subset_t {
+				std::shared_ptr<const Bits> bits;
+				std::shared_ptr<std::vector<uint32_t>> index;
+				size_t first, last;
+			};
+			BitSubsets(const arti::AttributeMatrix &m, const std::vector<uint32_t> &elements) :
+				matrix_(m), words_((m.element_count() + 63) / 64), values_(m.attribute_count()), occurring_(m.attribute_count()) {
+				for (size_t a = 0; a < m.attribute_count(); a++) {
+					values_[a].resize(m.value_limit(a));
+					const uint8_t * column = m.column(a);
+					for (size_t e = 0; e < m.element_count(); e++) {
+						auto &bits = values_[a][column[e]];
+						if (bits.empty()) bits.resize(words_, 0);
+						bits[e / 64] |= (uint64_t) 1 << (e % 64);
+					}
+					for (int v = 0; v < m.value_limit(a); v++)
+						if (!values_[a][v].empty()) occurring_[a].push_back(v);
+				}
+				std::shared_ptr<Bits> r(new Bits());
+				r->classes.assign(m.class_limit(), std::vector<uint64_t>(words_, 0));
+				r->class_sizes.assign(m.class_limit(), 0);
+				for (auto e : elements) {
+					const int c = m.class_of(e);
+					uint64_t &word = r->classes[c][e / 64];
+					const uint64_t bit = (uint64_t) 1 << (e % 64);
+					if (!(word & bit)) r->class_sizes[c]++;
+					word |= bit;
+				}
+				r->size = 0;
+				for (auto n : r->class_sizes) r->size += n;
+				r->lo = 0;
+				r->hi = words_;
+				root_.bits = r;
+				root_.first = root_.last = 0;
+			}
+			subset_t root() const {return root_;}
+			static size_t size(const subset_t &s) {return s.bits ? s.bits->size : s.last - s.first;}
+			void count(const size_t attribute, const subset_t &s, std::vector<int> &counts) const {
+				if (!s.bits) {
+					count_range(matrix_, attribute, s.index->data(), s.first, s.last, counts);
+					return;
+				}
+				const Bits &b = *s.bits;
+				const int class_limit = matrix_.class_limit();
+				counts.assign(matrix_.value_limit(attribute) * class_limit, 0);
+				const auto &occurring = occurring_[attribute];
+				for (int c = 0; c < class_limit; c++) {
+					if (b.class_sizes[c] == 0) continue;
+					int rest = b.class_sizes[c];
+					for (size_t i = 0; i + 1 < occurring.size(); i++) {
+						const int v = occurring[i];
+						const int n = and_count(b.classes[c].data(), values_[attribute][v].data() + b.lo, b.hi - b.lo);
+						counts[v * class_limit + c] = n;
+						rest -= n;
+					}
+					counts[occurring.back() * class_limit + c] = rest;
+				}
+			}
+			/* children[v] gets the elements with value v */
+			void split(const size_t attribute, const subset_t &s, const std::vector<int> &counts, std::vector<subset_t> &children) const {
+				if (!s.bits) {
+					static thread_local std::vector<uint32_t> scratch;
+					std::vector<size_t> bounds;
+					split_range(matrix_, attribute, s.index->data(), s.first, s.last, counts, bounds, scratch);
+					for (size_t v = 0; v + 1 < bounds.size(); v++)
+						children.push_back(subset_t{nullptr, s.index, bounds[v], bounds[v + 1]});
+					return;
+				}
+				const Bits &b = *s.bits;
+				const int class_limit = matrix_.class_limit();
+				children.assign(matrix_.value_limit(attribute), subset_t{nullptr, nullptr, 0, 0});
+				for (auto v : occurring_[attribute]) {
+					std::vector<int> class_sizes;
+					size_t size = 0;
+					for (int c = 0; c < class_limit; c++) {
+						class_sizes.push_back(counts[v * class_limit + c]);
+						size += class_sizes.back();
+					}
+					if (size == 0) continue;
+					const uint64_t * value = values_[attribute][v].data() + b.lo;
+					// the words of the child are a range of those of the parent
+					size_t lo = b.hi - b.lo, hi = 0;
+					for (int c = 0; c < class_limit; c++)
+						if (class_sizes[c] > 0)
+							for (size_t w = 0; w < b.hi - b.lo; w++)
+								if ((b.classes[c][w] & value[w]) != 0) {
+									lo = std::min(lo, w);
+									hi = std::max(hi, w + 1);
+								}
+					if (size < sparse_factor * (hi - lo)) {
+						std::shared_ptr<std::vector<uint32_t>> index(new std::vector<uint32_t>());
+						for (size_t w = lo; w < hi; w++) {
+							uint64_t word = 0;
+							for (int c = 0; c < class_limit; c++)
+								if (class_sizes[c] > 0)
+									word |= b.classes[c][w] & value[w];
+							for (; word != 0; word &= word - 1)
+								index->push_back((uint32_t) (64 * (b.lo + w) + arti::lowest_index(word)));
+						}
+						children[v] = subset_t{nullptr, index, 0, index->size()};
+						continue;
+					}
+					std::shared_ptr<Bits> child(new Bits());
+					child->lo = b.lo + lo;
+					child->hi = b.lo + hi;
+					child->class_sizes = class_sizes;
+					child->size = size;
+					child->classes.resize(class_limit);
+					for (int c = 0; c < class_limit; c++)
+						if (class_sizes[c] > 0)
+							for (size_t w = lo; w < hi; w++)
+								child->classes[c].push_back(b.classes[c][w] & value[w]);
+					children[v].bits = child;
+				}
+			}
+		private:
+			const arti::AttributeMatrix &matrix_;
+			const size_t words_;
+			std::vector<std::vector<std::vector<uint64_t>>> values_; // [attribute][value], empty if the value does not occur
+			std::vector<std::vector<int>> occurring_; // the values of each attribute that occur
+			subset_t root_;
+	};
+
+	/**
+	 * Builds the tree below a node.  Subsets is IndexSubsets or BitSubsets; both give the same counts,
+	 * and the entropies are computed from the counts only, so they build the same tree.  The nodes get
+	 * the values and classes of codes, which are those of the matrix if there are no codes.
+	 */
+	template <class Subsets> class Trainer {
+		public:
+			typedef typename Subsets::subset_t subset_t;
+			Trainer(const arti::AttributeMatrix &m, const arti::ValueCodes *codes, Subsets &subsets, const size_t cut_off, arti::WorkerPool *pool,
+				const size_t threshold, const size_t sample, const uint64_t seed, arti::ID3NodeTiming &timing) :
+				matrix_(m), codes_(codes), subsets_(subsets), cut_off_(cut_off), pool_(pool), threshold_(threshold), sample_(sample), seed_(seed),
+				class_limit_(m.class_limit()), nlog2n_(std::max(m.element_count(), Subsets::size(subsets.root())) + 1, 0.0), timing_(timing) {
+				for (size_t n = 2; n < nlog2n_.size(); n++)
+					nlog2n_[n] = n * std::log2((double) n);
+			}
+			void train(arti::ID3Node &root) {
+				std::vector<size_t> attributes;
+				for (size_t a = 0; a < matrix_.attribute_count(); a++)
+					attributes.push_back(a);
+				train(root, attributes, root_key());
+			}
+			Subsets &subsets() {return subsets_;}
+			/* the value of the code of the attribute in the matrix, and the other way round */
+			int value(const size_t attribute, const int code) const {return codes_ ? codes_->value(attribute, code) : code;}
+			int code(const size_t attribute, const int value) const {return codes_ ? codes_->find(attribute, value) : value;}
+			int klass(const int code) const {return codes_ ? codes_->class_of(code) : code;}
+			/* the key of the root; a child has the key splitmix64(key + value + 1), of its value and not its code */
+			uint64_t root_key() const {return arti::splitmix64(seed_);}
+			/* builds the subtree of node from all elements of the subsets, which do not include its children */
+			void train(arti::ID3Node &node, const std::vector<size_t> &attributes, const uint64_t key) {
+				std::vector<int> counts;
+				subsets_.count(attributes.front(), subsets_.root(), counts);
+				node.class_count.clear();
+				for (size_t i = 0; i < counts.size(); i++)
+					if (counts[i] > 0)
+						node.class_count[klass((int) (i % class_limit_))] += counts[i];
+				if (pool_) {
+					arti::TaskGroup subtrees(*pool_);
+					train(node, subsets_.root(), attributes, key, &subtrees);
+					subtrees.wait();
+				} else
+					train(node, subsets_.root(), attributes, key, nullptr);
+			}
+			/*
+			 * The sum over the values of the fraction of elements with the value times the entropy of their
+			 * classes, which is (sum over v of Nv.log2(Nv) - sum over v and c of Nvc.log2(Nvc)) / N
+			 */
+			float entropy_of(const std::vector<int> &counts, const size_t n) const {
+				double result = 0.0;
+				for (size_t v = 0; v < counts.size(); v += class_limit_) {
+					int nv = 0;
+					for (int c = 0; c < class_limit_; c++) {
+						nv += counts[v + c];
+						result -= nlog2n_[counts[v + c]];
+					}
+					result += nlog2n_[nv];
+				}
+				return (float) (result / n);
+			}
+
+			/*
+			 * The attributes that a node scores: all of them, or sample_ of them that are drawn with key,
+			 * which depends on the path to the node only
+			 */
+			std::vector<size_t> candidates(const std::vector<size_t> &attributes, uint64_t key) const {
+				std::vector<size_t> result(attributes);
+				if (sample_ == 0 || sample_ >= result.size())
+					return result;
+				for (size_t i = 0; i < sample_; i++) {
+					key = arti::splitmix64(key + 0x9e3779b97f4a7c15ULL);
+					std::swap(result[i], result[i + key % (result.size() - i)]);
+				}
+				result.resize(sample_);
+				return result;
+			}
+
+			/* a tie goes to the lowest attribute, so that the order of attributes does not matter */
+			static size_t best_of(const std::vector<size_t> &scored, const std::vector<float> &entropies) {
+				size_t best = 0;
+				for (size_t i = 1; i < scored.size(); i++)
+					if (entropies[i] < entropies[best] || (entropies[i] == entropies[best] && scored[i] < scored[best]))
+						best = i;
+				return best;
+			}
+			/* the attribute with the lowest entropy, of those that a node with key scores */
+			size_t select(const subset_t &subset, const std::vector<size_t> &attributes, const uint64_t key, float &entropy) {
+				const size_t n = Subsets::size(subset);
+				const std::vector<size_t> scored = candidates(attributes, key);
+				std::vector<float> entropies(scored.size());
+				auto score = [&] (const size_t i) {
+					static thread_local std::vector<int> counts;
+					subsets_.count(scored[i], subset, counts);
+					entropies[i] = entropy_of(counts, n);
+				};
+				if (pool_ && n * scored.size() >= threshold_)
+					pool_->parallel_for(scored.size(), score);
+				else
+					for (size_t i = 0; i < scored.size(); i++) score(i);
+				const size_t best = best_of(scored, entropies);
+				entropy = entropies[best];
+				return scored[best];
+			}
+		private:
+			const arti::AttributeMatrix &matrix_;
+			const arti::ValueCodes * const codes_;
+			Subsets &subsets_;
+			const size_t cut_off_;
+			arti::WorkerPool * const pool_;
+			const size_t threshold_;
+			const size_t sample_;
+			const uint64_t seed_;
+			const int class_limit_;
+			std::vector<double> nlog2n_; // n * log2(n)
+			arti::ID3NodeTiming &timing_;
+			std::mutex timing_mutex_;
+
+			/* subtrees is null when the children are built serially; key seeds the attribute sample */
+			void train(arti::ID3Node &parent, const subset_t &subset, const std::vector<size_t> &attributes, const uint64_t key, arti::TaskGroup *subtrees) {
+				ENSURE(!attributes.empty(),"there are no attributes to classify");
+				const size_t n = Subsets::size(subset);
+				ENSURE(n > 0,"elements cannot be empty");
+				if (cut_off_ > 0 && n < cut_off_) return; // minimal object pruning
+				arti::Stopwatch watch;
+				// select the best attribute -- that is the one with the lowest entropy
+				const size_t selected = select(subset, attributes, key, parent.best_entropy);
+				// use selected to split elements
+				std::vector<int> counts;
+				subsets_.count(selected, subset, counts);
+				std::vector<subset_t> children;
+				subsets_.split(selected, subset, counts, children);
+				// the children are made in the order of their values, so the tree does not depend on the codes
+				std::vector<size_t> order(children.size());
+				for (size_t v = 0; v < order.size(); v++)
+					order[v] = v;
+				if (codes_)
+					std::sort(order.begin(), order.end(), [&](const size_t x, const size_t y) {return value(selected, (int) x) < value(selected, (int) y);});
+				for (auto v : order) {
+					if (Subsets::size(children[v]) == 0) continue;
+					// is there more than one classification; a tie goes to the lowest class, as in Updater
+					const int * classes = &counts[v * class_limit_];
+					int best_class = 0, class_count = 0;
+					for (int c = 0; c < class_limit_; c++) {
+						if (classes[c] > 0) class_count++;
+						if (classes[c] > classes[best_class] || (classes[c] == classes[best_class] && klass(c) < klass(best_class)))
+							best_class = c;
+					}
+					// one classification makes a leaf
+					const int value_v = value(selected, (int) v);
+					parent.childs.emplace_front(parent.level+1, selected, value_v, klass(best_class), class_count == 1);
+					parent.value_count[value_v] = (int) Subsets::size(children[v]);
+					for (int c = 0; c < class_limit_; c++)
+						if (classes[c] > 0)
+							parent.childs.front().class_count[klass(c)] = classes[c];
+				}
+				{
+					std::lock_guard<std::mutex> lock(timing_mutex_);
+					timing_.add(n, watch.seconds());
+				}
+				// now expand non-leafs
+				if (attributes.size() == 1) return;
+				std::shared_ptr<std::vector<size_t>> remaining(new std::vector<size_t>(attributes));
+				remaining->erase(std::find(remaining->begin(), remaining->end(), selected));
+				FOR_EACH(c, parent.childs) {
+					if (c->is_classified_leaf) continue;
+					const subset_t child_subset = children[code(selected, c->value)];
+					const uint64_t child_key = arti::splitmix64(key + c->value + 1);
+					if (subtrees && Subsets::size(child_subset) * remaining->size() >= threshold_) {
+						arti::ID3Node *child = &*c;
+						subtrees->run([this,child,child_subset,remaining,child_key,subtrees]() {train(*child, child_subset, *remaining, child_key, subtrees);});
+					} else
+						train(*c, child_subset, *remaining, child_key, subtrees);
+				}
+			}
+	};
+
+	/*
+	 * Brings the nodes that new elements reach up to date, so that the tree becomes the one that
+	 * training on all elements builds.  A node that keeps its attribute only passes the new elements on
+	 * to its childs; a node that changes its attribute, or gets a value that it has no child for, is trained again.
+	 */
+	class Updater {
+		public:
+			/* nodes with at least counted_size elements keep their counts in tables */
+			static const size_t counted_size = 256;
+			Updater(const arti::AttributeMatrix &m, std::vector<uint32_t> &work, Trainer<IndexSubsets> &trainer, const size_t cut_off,
+				std::unordered_map<const arti::ID3Node*, arti::ID3NodeCounts> &tables) :
+				matrix_(m), work_(work), trainer_(trainer), cut_off_(cut_off), tables_(tables) {}
+			/* elements are all training elements of node, added are those that are new */
+			void update(arti::ID3Node &node, const std::vector<uint32_t> &elements, const std::vector<uint32_t> &added,
+				const std::vector<size_t> &attributes, const uint64_t key) {
+				for (auto e : added)
+					node.class_count[trainer_.klass(matrix_.class_of(e))]++;
+				if (!node.is_root()) {
+					// as Trainer decides when it makes the node
+					int dominant = -1;
+					for (auto &c : node.class_count)
+						if (dominant < 0 || c.second > node.class_count[dominant])
+							dominant = c.first;
+					node.dominant_class = dominant;
+					node.is_classified_leaf = node.class_count.size() == 1;
+				}
+				if (node.is_classified_leaf || attributes.empty() || (cut_off_ > 0 && elements.size() < cut_off_))
+					return;
+				float entropy;
+				const size_t selected = select(node, elements, added, attributes, key, entropy);
+				if (node.childs.empty() || (size_t) node.childs.begin()->attribute != selected) {
+					retrain(node, elements, attributes, key);
+					return;
+				}
+				const uint8_t * column = matrix_.column(selected);
+				std::vector<std::vector<uint32_t>> all(matrix_.value_limit(selected)), fresh(all.size());
+				for (auto e : added)
+					fresh[column[e]].push_back(e);
+				for (size_t v = 0; v < fresh.size(); v++)
+					if (!fresh[v].empty() && node.value_count.find(trainer_.value(selected, (int) v)) == node.value_count.end()) {
+						retrain(node, elements, attributes, key);
+						return;
+					}
+				node.best_entropy = entropy;
+				for (auto e : elements)
+					all[column[e]].push_back(e);
+				std::vector<size_t> remaining;
+				if (attributes.size() > 1)
+					for (auto a : attributes)
+						if (a != selected) remaining.push_back(a);
+				for (auto &c : node.childs) {
+					const int v = trainer_.code(selected, c.value);
+					if (fresh[v].empty()) continue;
+					node.value_count[c.value] += (int) fresh[v].size();
+					update(c, all[v], fresh[v], remaining, arti::splitmix64(key + c.value + 1));
+				}
+			}
+		private:
+			const arti::AttributeMatrix &matrix_;
+			std::vector<uint32_t> &work_; // the elements of trainer_
+			Trainer<IndexSubsets> &trainer_;
+			const size_t cut_off_;
+			std::unordered_map<const arti::ID3Node*, arti::ID3NodeCounts> &tables_;
+
+			/* as Trainer::select, from the table of a large node */
+			size_t select(const arti::ID3Node &node, const std::vector<uint32_t> &elements, const std::vector<uint32_t> &added,
+				const std::vector<size_t> &attributes, const uint64_t key, float &entropy) {
+				if (elements.size() < counted_size) {
+					work_.assign(elements.begin(), elements.end());
+					return trainer_.select(trainer_.subsets().root(), attributes, key, entropy);
+				}
+				int values = 0;
+				for (size_t a = 0; a < matrix_.attribute_count(); a++)
+					values = std::max(values, matrix_.value_limit(a));
+				const int classes = matrix_.class_limit();
+				auto found = tables_.find(&node);
+				if (found != tables_.end() && found->second.values >= values && found->second.classes == classes)
+					add(found->second, added);
+				else {
+					arti::ID3NodeCounts &t = tables_[&node];
+					t.values = values;
+					t.classes = classes;
+					t.counts.assign(matrix_.attribute_count() * values * classes, 0);
+					add(t, elements);
+					found = tables_.find(&node);
+				}
+				const arti::ID3NodeCounts &t = found->second;
+				const std::vector<size_t> scored = trainer_.candidates(attributes, key);
+				std::vector<float> entropies(scored.size());
+				std::vector<int> counts;
+				for (size_t i = 0; i < scored.size(); i++) {
+					const size_t a = scored[i];
+					const int * table = &t.counts[a * t.values * classes];
+					counts.assign(table, table + matrix_.value_limit(a) * classes);
+					entropies[i] = trainer_.entropy_of(counts, elements.size());
+				}
+				const size_t best = Trainer<IndexSubsets>::best_of(scored, entropies);
+				entropy = entropies[best];
+				return scored[best];
+			}
+
+			void add(arti::ID3NodeCounts &t, const std::vector<uint32_t> &elements) const {
+				for (size_t a = 0; a < matrix_.attribute_count(); a++) {
+					const uint8_t * column = matrix_.column(a);
+					int * table = &t.counts[a * t.values * t.classes];
+					for (auto e : elements)
+						table[column[e] * t.classes + matrix_.class_of(e)]++;
+				}
+			}
+
+			/* drops the tables of the nodes below node */
+			void forget(const arti::ID3Node &node) {
+				for (auto &c : node.childs) {
+					tables_.erase(&c);
+					forget(c);
+				}
+			}
+
+			void retrain(arti::ID3Node &node, const std::vector<uint32_t> &elements, const std::vector<size_t> &attributes, const uint64_t key) {
+				forget(node);
+				node.childs.clear();
+				node.value_count.clear();
+				work_.assign(elements.begin(), elements.end());
+				trainer_.train(node, attributes, key);
+			}
+	};
 }
 
 namespace arti {
@@ -34,24 +566,6 @@ namespace arti {
 		::fill(*this,count);
 	}
 
-	void ElementIndexList::collect_random_subset(element_index_list_t &result, const size_t count) const {
-		const auto s = size();
-		CHECK(count < s);
-		double p = (count * 1.0)/(s*1.0);
-		static std::uniform_real_distribution<double> distribution(0.0,1.0);
-		auto it = begin();
-		std::set<size_t> rs;
-		while (rs.size() != count) {
-				if (distribution(generator) <= p) {
-					rs.insert(*it);
-				}
-				it++;
-				if (it == end())
-					it = begin();
-		}
-		result.insert_after(result.before_begin(), rs.begin(), rs.end());
-	}
-
 	bool ElementIndexList::contains(const size_t e) const {
 		return (std::find(begin(),end(),e) != end());
 	}
@@ -60,6 +574,173 @@ namespace arti {
 		insert_after(before_begin(), elems.begin(), elems.end());
 	}
 
+	ElementIndexSet::engine_t ElementIndexSet::engine(const unsigned seed, const unsigned stream) {
+		std::seed_seq seq{seed, stream};
+		return engine_t(seq);
+	}
+
+	ElementIndexSet ElementIndexSet::all(const size_t count) {
+		std::vector<uint32_t> elements(count);
+		for (size_t e = 0; e < count; e++)
+			elements[e] = (uint32_t) e;
+		return ElementIndexSet(std::move(elements));
+	}
+
+	ElementIndexSet::ElementIndexSet(std::vector<uint32_t> elements) : elements_(std::move(elements)) {
+		std::sort(elements_.begin(), elements_.end());
+		elements_.erase(std::unique(elements_.begin(), elements_.end()), elements_.end());
+	}
+
+	ElementIndexSet::ElementIndexSet(const element_index_list_t &elements) :
+		ElementIndexSet(std::vector<uint32_t>(elements.begin(), elements.end())) {
+	}
+
+	ElementIndexSet ElementIndexSet::sample(const size_t count, engine_t &engine) const {
+		ENSURE(count <= size(), "the sample is larger than the set");
+		// Floyd: for every j in [n-count,n) take a random position in [0,j], or j if that one was taken
+		std::unordered_set<size_t> taken(count * 2);
+		std::vector<uint32_t> result;
+		result.reserve(count);
+		for (size_t j = size() - count; j < size(); j++) {
+			const size_t t = std::uniform_int_distribution<size_t>(0, j)(engine);
+			const size_t position = taken.insert(t).second ? t : j;
+			if (position == j) taken.insert(j);
+			result.push_back(elements_[position]);
+		}
+		return ElementIndexSet(std::move(result));
+	}
+
+	std::vector<ElementIndexSet> ElementIndexSet::by_class(class_fn_t class_of) const {
+		std::vector<std::vector<uint32_t>> classes;
+		for (auto e : elements_) {
+			const int c = class_of(e);
+			ENSURE(c >= 0, "classes cannot be negative");
+			if ((size_t) c >= classes.size()) classes.resize(c + 1);
+			classes[c].push_back(e);
+		}
+		std::vector<ElementIndexSet> result;
+		for (auto &c : classes)
+			result.emplace_back(std::move(c));
+		return result;
+	}
+
+	ElementIndexSet ElementIndexSet::stratified_sample(const size_t numerator, const size_t denominator, class_fn_t class_of, engine_t &engine) const {
+		ENSURE(denominator > 0 && numerator <= denominator, "the fraction must be in [0,1]");
+		ElementIndexSet result;
+		for (auto &c : by_class(class_of))
+			result = result | c.sample(c.size() * numerator / denominator, engine);
+		return result;
+	}
+
+	ElementIndexSet ElementIndexSet::operator|(const ElementIndexSet &other) const {
+		ElementIndexSet result;
+		std::set_union(begin(), end(), other.begin(), other.end(), std::back_inserter(result.elements_));
+		return result;
+	}
+
+	ElementIndexSet ElementIndexSet::operator-(const ElementIndexSet &other) const {
+		ElementIndexSet result;
+		std::set_difference(begin(), end(), other.begin(), other.end(), std::back_inserter(result.elements_));
+		return result;
+	}
+
+	AttributeMatrix::AttributeMatrix(const size_t elementCount, const size_t attributeCount) :
+		elements_(elementCount), attributes_(attributeCount), stride_((elementCount + 63) & ~(size_t) 63),
+		buffer_(attributeCount * stride_ + 63), classes_(elementCount), value_limits_(attributeCount, 0), class_limit_(0) {
+		const auto misalignment = reinterpret_cast<std::uintptr_t>(buffer_.data()) & 63;
+		base_ = buffer_.data() + (misalignment == 0 ? 0 : 64 - misalignment);
+	}
+
+	void AttributeMatrix::fill(value_fn_t value_of, class_fn_t class_of, const unsigned threads) {
+		const size_t n = threads == 0 ? std::max(1U, std::thread::hardware_concurrency()) : threads;
+		// every thread encodes its own range of elements, so they write to different bytes
+		const size_t block = (elements_ + n - 1) / n;
+		std::vector<std::future<void>> futures;
+		for (size_t first = block; first < elements_; first += block) {
+			const size_t last = std::min(elements_, first + block);
+			futures.push_back(std::async(std::launch::async, [this,first,last,&value_of,&class_of]() {
+				fill(first, last, value_of, class_of);
+			}));
+		}
+		fill(0, std::min(elements_, block), value_of, class_of);
+		for (auto &f : futures)
+			f.get();
+		find_limits();
+	}
+
+	void AttributeMatrix::fill(const AttributeMatrix &other, value_fn_t value_of, class_fn_t class_of) {
+		ENSURE(other.attributes_ == attributes_ && other.elements_ <= elements_, "the matrix cannot hold the other matrix");
+		for (size_t a = 0; a < attributes_; a++)
+			std::copy(other.column(a), other.column(a) + other.elements_, base_ + a * stride_);
+		std::copy(other.classes_.begin(), other.classes_.end(), classes_.begin());
+		fill(other.elements_, elements_, value_of, class_of);
+		find_limits();
+	}
+
+	void AttributeMatrix::fill(const uint8_t *columns, const uint8_t *classes) {
+		for (size_t a = 0; a < attributes_; a++)
+			std::copy(columns + a * elements_, columns + (a + 1) * elements_, base_ + a * stride_);
+		std::copy(classes, classes + elements_, classes_.begin());
+		find_limits();
+	}
+
+	void AttributeMatrix::find_limits() {
+		class_limit_ = elements_ == 0 ? 0 : 1 + *std::max_element(classes_.begin(), classes_.end());
+		for (size_t a = 0; a < attributes_; a++)
+			value_limits_[a] = elements_ == 0 ? 0 : 1 + *std::max_element(column(a), column(a) + elements_);
+	}
+
+	void AttributeMatrix::fill(const size_t first, const size_t last, value_fn_t &value_of, class_fn_t &class_of) {
+		for (size_t e = first; e < last; e++) {
+			const int c = class_of(e);
+			ENSURE(c >= 0 && c < 256, "class does not fit the attribute matrix");
+			classes_[e] = (uint8_t) c;
+			for (size_t a = 0; a < attributes_; a++) {
+				const int v = value_of(e, a);
+				ENSURE(v >= 0 && v < 256, "value does not fit the attribute matrix");
+				base_[a * stride_ + e] = (uint8_t) v;
+			}
+		}
+	}
+
+	int ValueCodes::code_of(const int value, std::vector<int> &values, std::unordered_map<int, int> &codes) {
+		auto found = codes.find(value);
+		if (found != codes.end())
+			return found->second;
+		ENSURE(values.size() < 256, "there are more than 256 different values");
+		codes[value] = (int) values.size();
+		values.push_back(value);
+		return (int) values.size() - 1;
+	}
+
+	int ValueCodes::find(const size_t attribute, const int value) const {
+		auto found = value_codes_[attribute].find(value);
+		return found == value_codes_[attribute].end() ? -1 : found->second;
+	}
+
+	void ID3NodeTiming::add(const size_t elements, const double seconds) {
+		size_t bucket = 0;
+		while ((elements >> (bucket + 1)) > 0) bucket++;
+		if (nodes_.size() <= bucket) {
+			nodes_.resize(bucket + 1, 0);
+			seconds_.resize(bucket + 1, 0.0);
+		}
+		nodes_[bucket]++;
+		seconds_[bucket] += seconds;
+	}
+
+	int ID3NodeTiming::nodes() const {
+		int result = 0;
+		for (auto n : nodes_) result += n;
+		return result;
+	}
+
+	double ID3NodeTiming::seconds() const {
+		double result = 0.0;
+		for (auto s : seconds_) result += s;
+		return result;
+	}
+
 	std::ostream& operator<<(std::ostream &os, const ID3Node& v) {
 		std::string space;
 		for (int i = 0; i < v.level;i++) space += ".";
@@ -93,60 +774,149 @@ namespace arti {
 		}
 	}
 
-  int ID3Classifier::classify(const size_t element, const ID3Node &node) {
-		if (!node.is_leaf()) {
-			const int val = value_of(element, node.childs.begin()->attribute);
-			FOR_EACH(c, node.childs) 
-				if (c->value == val)
-					return classify(element, *c);
+	template <class N> static void breadth_first_of(N &root, std::vector<N*> &order) {
+		order.clear();
+		order.push_back(&root);
+		for (size_t i = 0; i < order.size(); i++)
+			if (!order[i]->is_leaf())
+				for (auto &c : order[i]->childs)
+					order.push_back(&c);
+	}
+
+	void CompiledTree::breadth_first(const ID3Node& root, std::vector<const ID3Node*> &order) {
+		breadth_first_of(root, order);
+	}
+
+	void CompiledTree::breadth_first(ID3Node& root, std::vector<ID3Node*> &order) {
+		breadth_first_of(root, order);
+	}
+
+	CompiledTree::CompiledTree(const ID3Node& root) {
+		std::vector<const ID3Node*> order;
+		breadth_first(root, order);
+		nodes_.reserve(order.size() * 2);
+		parents_.reserve(order.size() * 2);
+		for (auto n : order) {
+			ENSURE(n->dominant_class >= -(1 << 15) && n->dominant_class < (1 << 15), "class does not fit a compiled node");
+			nodes_.push_back({-1, 0, 0, 0, (int16_t) n->dominant_class});
+			parents_.push_back(-1);
 		}
-		return node.dominant_class;
+		// the children of order[i] follow each other, after those of order[i-1]
+		int32_t child = 1;
+		for (size_t i = 0; i < order.size(); i++) {
+			const ID3Node &n = *order[i];
+			if (n.is_leaf())
+				continue;
+			int low = n.childs.begin()->value, high = low;
+			for (auto &c : n.childs) {
+				low = std::min(low, c.value);
+				high = std::max(high, c.value);
+			}
+			ENSURE((int64_t) high - low < (1 << 16) - 1, "the values of a node do not fit a compiled node");
+			const int values = high - low + 1;
+			const int32_t first = (int32_t) children_.size();
+			const int32_t other = (int32_t) nodes_.size();
+			nodes_[i].attribute = n.childs.begin()->attribute;
+			nodes_[i].first = first;
+			nodes_[i].low = low;
+			nodes_[i].values = (uint16_t) values;
+			nodes_.push_back({-1, 0, 0, 0, nodes_[i].klass});
+			parents_.push_back((int32_t) i);
+			children_.resize(first + values + 1, other);
+			for (auto &c : n.childs) {
+				children_[first + c.value - low] = child;
+				parents_[child++] = (int32_t) i;
+			}
+		}
+	}
+
+	bool CompiledTree::operator==(const CompiledTree &o) const {
+		auto same = [](const Node &a, const Node &b) {
+			return a.attribute == b.attribute && a.first == b.first && a.low == b.low && a.values == b.values && a.klass == b.klass;
+		};
+		return nodes_.size() == o.nodes_.size() && std::equal(nodes_.begin(), nodes_.end(), o.nodes_.begin(), same)
+			&& children_ == o.children_ && parents_ == o.parents_;
 	}
 
-  bool ID3Classifier::test_classify(const size_t element, ID3Node &node, const int expected_class) {
-		node.test_count++;
-		if (!node.is_leaf()) {
-			const int val = value_of(element, node.childs.begin()->attribute);
-			FOR_EACH(c, node.childs) 
-				if (c->value == val) {
-					const bool is_correct = test_classify(element, *c, expected_class);
-					if (!is_correct)
-						node.test_errors++;
-					return is_correct;
+	void CompiledTree::classify(const AttributeMatrix &m, const uint32_t *elements, const size_t count, int *classes) const {
+		const size_t lanes = 16;
+		int node[lanes];
+		for (size_t first = 0; first < count; first += lanes) {
+			const size_t n = std::min(lanes, count - first);
+			const uint32_t *e = elements + first;
+			for (size_t i = 0; i < n; i++)
+				node[i] = 0;
+			for (bool descending = true; descending;) {
+				descending = false;
+				for (size_t i = 0; i < n; i++) {
+					const Node &d = nodes_[node[i]];
+					if (d.attribute >= 0) {
+						const unsigned v = (unsigned) m.column(d.attribute)[e[i]] - (unsigned) d.low;
+						node[i] = children_[d.first + std::min(v, (unsigned) d.values)];
+						descending = true;
+					}
 				}
-		} 
-		const bool is_correct = expected_class == node.dominant_class;
-		if (!is_correct)
-			node.test_errors++;
-		return is_correct;
-}
+			}
+			for (size_t i = 0; i < n; i++)
+				classes[first + i] = nodes_[node[i]].klass;
+		}
+	}
+
+	void ID3Classifier::classify(const uint32_t *elements, const size_t count, int *classes) {
+		bool all_encoded = matrix_ != nullptr;
+		for (size_t i = 0; i < count && all_encoded; i++)
+			all_encoded = encoded(elements[i]);
+		if (all_encoded)
+			tree_.classify(*matrix_, elements, count, classes);
+		else
+			for (size_t i = 0; i < count; i++)
+				classes[i] = classify(elements[i]);
+	}
+
+	void ID3Classifier::encode(const size_t elementCount, const size_t attributeCount, const unsigned threads) {
+		std::shared_ptr<AttributeMatrix> m(new AttributeMatrix(elementCount, attributeCount));
+		m->fill(
+			[this](const size_t e, const size_t a) {return value_of(e, a);},
+			[this](const size_t e) {return class_of(e);},
+			threads);
+		matrix_ = m;
+	}
+
+	void ID3Classifier::encode_codes(const size_t elementCount, const size_t attributeCount) {
+		if (!codes_)
+			codes_.reset(new ValueCodes(attributeCount));
+		ValueCodes &codes = *codes_;
+		auto value = [this,&codes](const size_t e, const size_t a) {return codes.code_of(a, value_of(e, a));};
+		auto klass = [this,&codes](const size_t e) {return codes.class_code_of(class_of(e));};
+		// codes are added in the order of the elements, on one thread
+		std::shared_ptr<AttributeMatrix> m(new AttributeMatrix(elementCount, attributeCount));
+		if (coded_)
+			m->fill(*coded_, value, klass);
+		else
+			m->fill(value, klass, 1);
+		coded_ = m;
+	}
 
 	void ID3Classifier::train(const size_t elementCount, const size_t attributeCount) {
-		ENSURE(_root.is_leaf(),"classifier has already been trained");
-		std::forward_list<size_t> elems,attribs;
-		fill(elems,elementCount);
-		fill(attribs,attributeCount);
-		train(elems,attribs,_root);
+		std::vector<uint32_t> elems;
+		for (size_t i = 0; i < elementCount; i++)
+			elems.push_back((uint32_t) i);
+		train(elems,attributeCount);
 	}
 
   void ID3Classifier::train(std::forward_list<size_t> &elements, const size_t attributeCount) {
-		ENSURE(_root.is_leaf(),"classifier has already been trained");
-		std::forward_list<size_t> attribs;
-		fill(attribs,attributeCount);
-		train(elements,attribs,_root);
+		std::vector<uint32_t> elems(elements.begin(), elements.end());
+		train(elems,attributeCount);
   }
 
-
   void ID3Classifier::train_and_test(const size_t elementCount, const size_t attributeCount, const size_t test_denominator) {
-		ENSURE(_root.is_leaf(),"classifier has already been trained");
-		std::forward_list<size_t> elems,attribs,test_elems;
+		std::forward_list<size_t> elems,test_elems;
 		if (test_denominator > 0) {
 			fill_split(elems,test_elems,elementCount,test_denominator);
 			ENSURE(size_of(test_elems) > 0, "test_denominator identified no test elements");
 		} else
 			fill(elems,elementCount);
-		fill(attribs,attributeCount);
-		train(elems,attribs,_root);
+		train(elems,attributeCount);
 		LOG << "Training done for " << size_of(elems);
 		if (test_denominator > 0) {
 			test(test_elems);
@@ -157,84 +927,90 @@ namespace arti {
 		}
 	}
 
-	void ID3Classifier::train(std::forward_list<size_t> &elements, std::forward_list<size_t> &attributes, ID3Node &parent) {
-		ENSURE(size_of(attributes)>0,"there are no attributes to classify");
-		if (mo_cut_off_ > 0 && size_of(elements) < mo_cut_off_) return; // minimal object pruning
-		// select the best attribute -- that is the one with the lowest entropy
-		typedef std::pair<int,float> entropy_t;
-		std::vector<entropy_t> entropies(size_of(attributes));
-		std::transform(attributes.begin(),attributes.end(),entropies.begin(),[&] (const int a)
-			{
-				const float e = entropy_of(a,elements);
-				return entropy_t(a,e);
-			});
-//		FOR_EACH(e,entropies) {TRACE << e->first << ":" << e->second;};
-		auto selected_it = std::min_element(entropies.begin(),entropies.end(),[] (const entropy_t& a, const entropy_t& b) 
-			{return a.second < b.second;});
-		const int selected = selected_it->first;
-		parent.best_entropy = selected_it->second;
-//		if (parent.best_entropy == 0) return;
-		// use selected to split elements
-		std::map<int,std::forward_list<size_t>> split; // attribute value -> elements
-		FOR_EACH(e, elements) split[value_of(*e,selected)].push_front(*e);
-		FOR_EACH(s, split) {
-			// is there more than one classification
-			mapii classes; // class -> count
-			FOR_EACH(e, s->second) classes[class_of(*e)]++;
-			if (classes.size() == 1) // one classification, create a leaf
-				parent.childs.emplace_front(parent.level+1,selected, s->first, classes.begin()->first,true);
-			else { // there is more than one classification -- create a non-leaf 
-				auto best_class = std::max_element(classes.begin(), classes.end(),[](mapii::const_reference a, mapii::const_reference b) 
-					{return a.second < b.second;});
-				parent.childs.emplace_front(parent.level+1,selected, s->first,best_class->first,false);
-			}
-		}	
-		// now expand non-leafs
-		attributes.remove(selected); // remove processed attribute
-		const bool has_attributes = !attributes.empty();
-		FOR_EACH(c, parent.childs) {
-			if (!c->is_classified_leaf) {
-				if (has_attributes)
-					train(split[c->value],attributes,*c);
-			}
-		}
-		attributes.push_front(selected); // put attribute back -- parent set remains unchanges
+	void ID3Classifier::train(std::vector<uint32_t> &elements, const size_t attributeCount) {
+		ENSURE(_root.is_leaf(),"classifier has already been trained");
+		ENSURE(attributeCount > 0,"there are no attributes to classify");
+		ENSURE(!elements.empty(),"elements cannot be empty");
+		const size_t needed = 1 + *std::max_element(elements.begin(), elements.end());
+		if (matrix_) {
+			ENSURE(matrix_->attribute_count() == attributeCount, "the attribute matrix was encoded for other attributes");
+			ENSURE(matrix_->element_count() >= needed, "the attribute matrix does not have all elements");
+			coded_ = matrix_;
+			codes_.reset();
+		} else {
+			coded_.reset();
+			codes_.reset();
+			encode_codes(needed, attributeCount);
+		}
+		training_ = elements;
+		node_counts_.clear();
+		WorkerPool * const pool = pool_ && pool_->workers() > 1 ? pool_ : nullptr;
+		timing_ = ID3NodeTiming();
+		if (engine_ == Bitsets) {
+			BitSubsets subsets(*coded_, elements);
+			Trainer<BitSubsets> trainer(*coded_, codes_.get(), subsets, mo_cut_off_, pool, parallel_threshold_, attribute_sample_, sample_seed_, timing_);
+			trainer.train(_root);
+		} else {
+			IndexSubsets subsets(*coded_, elements);
+			Trainer<IndexSubsets> trainer(*coded_, codes_.get(), subsets, mo_cut_off_, pool, parallel_threshold_, attribute_sample_, sample_seed_, timing_);
+			trainer.train(_root);
+		}
+		tree_ = CompiledTree(_root);
+	}
+
+	void ID3Classifier::update(const std::vector<uint32_t> &elements) {
+		ENSURE(!training_.empty(), "only a trained classifier can be updated");
+		if (elements.empty()) return;
+		const size_t needed = 1 + *std::max_element(elements.begin(), elements.end());
+		if (needed > coded_->element_count()) {
+			if (codes_)
+				encode_codes(needed, coded_->attribute_count());
+			else {
+				std::shared_ptr<AttributeMatrix> m(new AttributeMatrix(needed, matrix_->attribute_count()));
+				m->fill(*matrix_,
+					[this](const size_t e, const size_t a) {return value_of(e, a);},
+					[this](const size_t e) {return class_of(e);});
+				matrix_ = coded_ = m;
+			}
+		}
+		training_.insert(training_.end(), elements.begin(), elements.end());
+		std::vector<uint32_t> work(training_);
+		IndexSubsets subsets(*coded_, work);
+		WorkerPool * const pool = pool_ && pool_->workers() > 1 ? pool_ : nullptr;
+		timing_ = ID3NodeTiming();
+		Trainer<IndexSubsets> trainer(*coded_, codes_.get(), subsets, mo_cut_off_, pool, parallel_threshold_, attribute_sample_, sample_seed_, timing_);
+		std::vector<size_t> attributes;
+		for (size_t a = 0; a < coded_->attribute_count(); a++)
+			attributes.push_back(a);
+		Updater(*coded_, work, trainer, mo_cut_off_, node_counts_).update(_root, training_, elements, attributes, trainer.root_key());
+		tree_ = CompiledTree(_root);
 	}
 
 	void ID3Classifier::test(const std::forward_list<size_t> &elements) {
-		_root.clear_test_data();
-		for (auto e : elements)
-			test_classify(e, _root, class_of(e));
-	}
-
- 	float ID3Classifier::entropy_of(const size_t attribute, const std::forward_list<size_t>& elements){
- 		const float count = size_of(elements);
- 		ENSURE(count > 0.0,"elements cannot be empty");
- 		float result = 0.0f;
- 		mapii values; 
- 		std::map<int,mapii> classes;  // attribute value -> class_map
- 		for(const auto e : elements) {
- 			auto v = value_of(e,attribute);
- 			auto c = class_of(e);
-			values[v]++;
-			classes[v][c]++;
- 		} 
- 		//TRACE << "attrib " << attribute; 
- 		FOR_EACH(p,values) {
- 			float ipn = 0.0f;
- 			FOR_EACH(c,classes[p->first]) {
- 				const float value_count = p->second;
- 				const float class_count = c->second;
- 				const float pripn = class_count / value_count;
- 				const float cipn = -pripn * ::log2(pripn);
- 				ipn += cipn;
- 				//TRACE << "value " << p->first << "class " << c->first << " has ipn " << cipn << " and class count " << class_count << " of total" << value_count;
- 			} 
- 			// TRACE << "value " << p->first << " has ipn " << ipn;
- 			const float pr = p->second / count;
- 			result += pr * ipn;
- 		}
- 		// TRACE << result;
- 		return result;
- 	}
+		// every node on the path to the leaf counts the element, and its error
+		std::vector<int> counts(tree_.size()), errors(tree_.size());
+		for (auto e : elements) {
+			const int leaf = tree_.leaf_of([this, e](const size_t a) {return value_at(e, a);});
+			const bool is_correct = tree_.class_of(leaf) == class_at(e);
+			for (int n = leaf; n >= 0; n = tree_.parent(n)) {
+				counts[n]++;
+				if (!is_correct)
+					errors[n]++;
+			}
+		}
+		std::vector<ID3Node*> order;
+		CompiledTree::breadth_first(_root, order);
+		for (size_t n = 0; n < order.size(); n++) {
+			order[n]->test_count = counts[n];
+			order[n]->test_errors = errors[n];
+		}
+	}
+
+	int MatrixClassifier::value_of(const size_t element, const size_t attribute) {
+		throw runtime_error_ex("element %d is not in the matrix", (int) element);
+	}
+
+	int MatrixClassifier::class_of(const size_t element) {
+		throw runtime_error_ex("element %d is not in the matrix", (int) element);
+	}
 }
@@ -3,14 +3,18 @@
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <unordered_map>
 #include <list>
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <forward_list>
 #include <iterator>
+#include <cstdint>
+#include <random>
 #include "systemex.h"
 #include "log.h"
+#include "workers.h"
 
 namespace arti {
 
@@ -23,13 +27,49 @@ template <class T> std::size_t size_of(const std::forward_list<T>& list) {
 class ElementIndexList : public std::forward_list<size_t> {
 public:
 		void fill(const size_t count);
-		void collect_random_subset(element_index_list_t &result, const size_t count) const;
-		void collect_random_half(element_index_list_t &result) const {collect_random_subset(result,size()/2);}
 		void prepend(const element_index_list_t &elems);
 		bool contains(const size_t e) const;
 		size_t size() const {return size_of(*this);}
 };
 
+/**
+ * A set of element indexes, kept sorted in one vector, for training and test sets.
+ * Sampling draws from an engine that the caller passes, so that every thread can draw from its own
+ * seeded engine and the sets do not depend on which thread draws them.
+ */
+class ElementIndexSet {
+public:
+   typedef std::mt19937 engine_t;
+   typedef std::function<int(const size_t element)> class_fn_t;
+   typedef std::vector<uint32_t>::const_iterator const_iterator;
+   /** an engine for stream of seed; streams of one seed are independent */
+   static engine_t engine(const unsigned seed, const unsigned stream = 0);
+   /** the elements [0,count) */
+   static ElementIndexSet all(const size_t count);
+   ElementIndexSet() {}
+   explicit ElementIndexSet(std::vector<uint32_t> elements);
+   explicit ElementIndexSet(const element_index_list_t &elements);
+   size_t size() const {return elements_.size();}
+   bool empty() const {return elements_.empty();}
+   const_iterator begin() const {return elements_.begin();}
+   const_iterator end() const {return elements_.end();}
+   const std::vector<uint32_t>& elements() const {return elements_;}
+   bool contains(const size_t e) const {return std::binary_search(elements_.begin(), elements_.end(), (uint32_t) e);}
+   /** the elements as a list, for the members that take one */
+   element_index_list_t list() const {return element_index_list_t(elements_.begin(), elements_.end());}
+   /** count different elements, each subset as likely as the others; Floyd's algorithm draws count times */
+   ElementIndexSet sample(const size_t count, engine_t &engine) const;
+   /** the elements of every class, by class */
+   std::vector<ElementIndexSet> by_class(class_fn_t class_of) const;
+   /** a sample of numerator/denominator of the elements of each class (rounded down) */
+   ElementIndexSet stratified_sample(const size_t numerator, const size_t denominator, class_fn_t class_of, engine_t &engine) const;
+   ElementIndexSet operator|(const ElementIndexSet &other) const;
+   /** the elements that are not in other */
+   ElementIndexSet operator-(const ElementIndexSet &other) const;
+private:
+   std::vector<uint32_t> elements_;
+};
+
 /** This classifier is an implementation of Quinlan's ID3 algorithm.
 In order to use it you have to index your attributes and elements attribute values 
 classes as integers. Attributes and element indexes are zero based and in sequence
@@ -51,10 +91,10 @@ public:
    const int level; /** root is zero */
    const int attribute; /** if -1, this is the root */
    const int value; /** if -1, this is the root */
-   const int dominant_class; /* dominant found during training */ 
-   const bool is_classified_leaf;
-   mapii class_count; // Nc 
-   mapii value_count; // Nv
+   int dominant_class; /* dominant found during training, or by ID3Classifier::update */ 
+   bool is_classified_leaf;
+   mapii class_count; // Nc, of the training elements of this node
+   mapii value_count; // Nv, of the attribute of the childs
    std::forward_list<ID3Node> childs;
    float best_entropy; // why the attribute for the childs was selected
    int test_count;
@@ -80,6 +120,156 @@ public:
 
 std::ostream& operator<<(std::ostream &os, const ID3Node& v);
 
+/**
+ * The nodes that training split and the seconds it took to split them, without their
+ * subtrees, by the log2 of the number of elements of the node.
+ */
+class ID3NodeTiming {
+public:
+   void add(const size_t elements, const double seconds);
+   /** bucket b has the nodes with [2^b,2^(b+1)) elements */
+   size_t buckets() const {return nodes_.size();}
+   int nodes(const size_t bucket) const {return nodes_[bucket];}
+   double seconds(const size_t bucket) const {return seconds_[bucket];}
+   int nodes() const;
+   double seconds() const;
+private:
+   std::vector<int> nodes_;
+   std::vector<double> seconds_;
+};
+
+/**
+ * The training elements of a node by attribute, value and class, which ID3Classifier::update keeps
+ * for large nodes so that it can score them without counting their elements again.
+ */
+struct ID3NodeCounts {
+   int values; // of every attribute
+   int classes;
+   std::vector<int> counts; // [(attribute * values + value) * classes + class]
+};
+
+/**
+ * The values and classes of a data set, encoded once so that training does not have to
+ * call value_of() and class_of() at every node.  The matrix is attribute major: the values of
+ * one attribute are next to each other, one byte each, and every column starts on a cache line.
+ */
+class AttributeMatrix {
+public:
+   typedef std::function<int(const size_t element, const size_t attribute)> value_fn_t;
+   typedef std::function<int(const size_t element)> class_fn_t;
+   AttributeMatrix(const size_t elementCount, const size_t attributeCount);
+   AttributeMatrix(const AttributeMatrix&) = delete;
+   AttributeMatrix& operator=(const AttributeMatrix&) = delete;
+   /**
+    * encodes all elements; values and classes must be in [0,255].  The elements are divided over
+    * threads (0 is one per core), so value_of and class_of must be safe to call concurrently
+    */
+   void fill(value_fn_t value_of, class_fn_t class_of, const unsigned threads = 0);
+   /** copies the elements of other, which has the same attributes and no more elements, and encodes the others */
+   void fill(const AttributeMatrix &other, value_fn_t value_of, class_fn_t class_of);
+   /** copies encoded elements: the columns of all attributes one after the other, and the classes */
+   void fill(const uint8_t *columns, const uint8_t *classes);
+   size_t element_count() const {return elements_;}
+   size_t attribute_count() const {return attributes_;}
+   const uint8_t* column(const size_t attribute) const {return base_ + attribute * stride_;}
+   const uint8_t* classes() const {return classes_.data();}
+   int value_of(const size_t element, const size_t attribute) const {return column(attribute)[element];}
+   int class_of(const size_t element) const {return classes_[element];}
+   /** one more than the highest value of the attribute */
+   int value_limit(const size_t attribute) const {return value_limits_[attribute];}
+   /** one more than the highest class */
+   int class_limit() const {return class_limit_;}
+private:
+   const size_t elements_;
+   const size_t attributes_;
+   const size_t stride_; // elements_ rounded up to a cache line
+   std::vector<uint8_t> buffer_;
+   uint8_t * base_; // the first cache line in buffer_
+   std::vector<uint8_t> classes_;
+   std::vector<int> value_limits_;
+   int class_limit_;
+   void fill(const size_t first, const size_t last, value_fn_t &value_of, class_fn_t &class_of);
+   void find_limits();
+};
+
+/**
+ * Codes for the values of every attribute, and for the classes, numbered from 0 in the order in
+ * which they are first seen, so that a matrix can hold data of which the values are any int and
+ * only as many counts are kept as there are different values.  A code keeps its value when more
+ * values are added.  There are at most 256 codes of each.
+ */
+class ValueCodes {
+public:
+   explicit ValueCodes(const size_t attributeCount) : values_(attributeCount), value_codes_(attributeCount) {}
+   /** the code of the value of the attribute, which is added if it is new */
+   int code_of(const size_t attribute, const int value) {return code_of(value, values_[attribute], value_codes_[attribute]);}
+   int class_code_of(const int c) {return code_of(c, classes_, class_codes_);}
+   /** the code of the value of the attribute, -1 if it has none */
+   int find(const size_t attribute, const int value) const;
+   int value(const size_t attribute, const int code) const {return values_[attribute][code];}
+   int class_of(const int code) const {return classes_[code];}
+private:
+   std::vector<std::vector<int>> values_; // by attribute and code
+   std::vector<std::unordered_map<int, int>> value_codes_;
+   std::vector<int> classes_;
+   std::unordered_map<int, int> class_codes_;
+   static int code_of(const int value, std::vector<int> &values, std::unordered_map<int, int> &codes);
+};
+
+/**
+ * A trained tree frozen into one array of small nodes for fast classification.  The nodes are in
+ * breadth first order and a node finds its child for a value by indexing a table, so a
+ * classification is a few dependent loads instead of a walk over lists and maps.  Every
+ * internal node has an extra leaf, with its dominant class, for the values that no child has.
+ */
+class CompiledTree {
+public:
+   /** the nodes of root and its subtrees, in the order of this tree */
+   static void breadth_first(const ID3Node& root, std::vector<const ID3Node*> &order);
+   static void breadth_first(ID3Node& root, std::vector<ID3Node*> &order);
+   explicit CompiledTree(const ID3Node& root);
+   /** the number of nodes, including the extra leaves */
+   size_t size() const {return nodes_.size();}
+   /** the bytes of the nodes and child tables */
+   size_t memory() const {return nodes_.size() * sizeof(Node) + children_.size() * sizeof(int32_t);}
+   /** the leaf that classifies an element of which value_of(attribute) is the value */
+   template <class V> int leaf_of(V value_of) const {
+      int n = 0;
+      while (nodes_[n].attribute >= 0) {
+         const Node &d = nodes_[n];
+         const unsigned v = (unsigned) value_of((size_t) d.attribute) - (unsigned) d.low;
+         n = children_[d.first + (v < d.values ? v : d.values)];
+      }
+      return n;
+   }
+   template <class V> int classify(V value_of) const {return nodes_[leaf_of(value_of)].klass;}
+   int classify(const AttributeMatrix &m, const size_t element) const {
+      return classify([&m, element](const size_t a) {return m.value_of(element, a);});
+   }
+   /**
+    * classes[i] becomes the class of elements[i].  Several elements descend together, one level
+    * at a time, so that the loads of their values overlap
+    */
+   void classify(const AttributeMatrix &m, const uint32_t *elements, const size_t count, int *classes) const;
+   int class_of(const int node) const {return nodes_[node].klass;}
+   /** -1 for the root */
+   int parent(const int node) const {return parents_[node];}
+   /** the same nodes and child tables, so the trees classify every element the same */
+   bool operator==(const CompiledTree &o) const;
+   bool operator!=(const CompiledTree &o) const {return !(*this == o);}
+private:
+   struct Node {
+      int32_t attribute; // of the children, -1 for a leaf
+      int32_t first;     // the child table in children_, values + 1 entries
+      int32_t low;       // the lowest value of the children
+      uint16_t values;   // the child for value v is at first + v - low, the extra leaf at first + values
+      int16_t klass;
+   };
+   std::vector<Node> nodes_;
+   std::vector<int32_t> children_;
+   std::vector<int32_t> parents_;
+};
+
 /**
  * The ID3Classifier produces an ID3Node that resolves values.
  * A client of this class inherits from it.  The responsibility of the client it to
@@ -93,31 +283,111 @@ private:
    ID3Node _root;
 public:   
    const size_t mo_cut_off_; // minimal object pruning cut-off
-   ID3Classifier(size_t cc = 0) : mo_cut_off_(cc) {}
-   /** the value the element has for the given attribute */
+   /**
+    * Arrays counts the values of a node from a contiguous list of its elements; Bitsets keeps
+    * the elements of a node, and the elements that have each value, as bitsets and counts with
+    * AND and popcount, which suits attributes with few values.  Both build the same tree, but
+    * Bitsets counts an element that occurs more than once in the training set once.
+    */
+   enum Engine {Arrays, Bitsets};
+   ID3Classifier(size_t cc = 0) : mo_cut_off_(cc), pool_(nullptr), parallel_threshold_(0), engine_(Arrays), attribute_sample_(0), sample_seed_(0), tree_(_root) {}
+   /**
+    * the value the element has for the given attribute.  Without a matrix values and classes can be
+    * any int, and classes must fit 16 bits, but every attribute, and the classes, can have at most 256
+    * different values.  A matrix of encode() or use_matrix() holds them as they are, in [0,255]
+    */
    virtual int value_of(const size_t element, const size_t attribute) = 0;
-   /** the class of the element */
+   /** the class of the element; see value_of() */
    virtual int class_of(const size_t element) = 0;
+   /**
+    * encodes value_of() and class_of() of all elements into a matrix that training, testing
+    * and classification then read instead; see AttributeMatrix::fill.  If this was not done,
+    * training codes the elements it needs on one thread into a matrix of its own (see ValueCodes),
+    * and testing and classification call value_of() and class_of()
+    */
+   void encode(const size_t elementCount, const size_t attributeCount, const unsigned threads = 0);
+   /** use a matrix that was encoded by another classifier of the same data */
+   void use_matrix(std::shared_ptr<const AttributeMatrix> matrix) {matrix_ = matrix;}
+   std::shared_ptr<const AttributeMatrix> matrix() const {return matrix_;}
+   /**
+    * scores the attributes of a node, and builds the subtrees below it, on the pool when the node
+    * has at least threshold elements times attributes; smaller nodes stay serial.  A pool of one
+    * worker is not used.  The tree does not depend on the pool: entropy ties go to the lowest
+    * attribute, and every subtree task works on its own elements and attributes
+    */
+   void set_pool(WorkerPool *pool, const size_t threshold = 1 << 16) {pool_ = pool; parallel_threshold_ = threshold;}
+   void set_engine(const Engine e) {engine_ = e;}
+   /**
+    * every node chooses its attribute from count of the attributes that it may use, drawn at random
+    * (0, the default, scores all of them).  The draw depends on seed and the path to the node only,
+    * so the tree does not depend on the pool
+    */
+   void set_attribute_sample(const size_t count, const unsigned seed) {attribute_sample_ = count; sample_seed_ = seed;}
+   /** of the last training or update */
+   const ID3NodeTiming& node_timing() const {return timing_;}
    /** train the classifier root node using all the elements*/
    void train(const size_t elementCount, const size_t attributeCount);
    /** train the classifier root node using a subset of the elements*/
    void train(std::forward_list<size_t> &elements, const size_t attributeCount);
+   /** train using the elements, which may repeat and are reordered; see set_engine */
+   void train(std::vector<uint32_t> &elements, const size_t attributeCount);
+   /**
+    * adds elements to the training set of a trained classifier and changes the tree into the one that
+    * training on the whole set builds.  Only the nodes that the new elements reach are scored again,
+    * the large ones from counts that are kept between updates, and only below a node whose attribute
+    * changes is the subtree trained again.  Elements that are not in the matrix are encoded into a
+    * larger copy of it
+    */
+   void update(const std::vector<uint32_t> &elements);
    /** splits elements according to denominator into example and test set.
     * if denominator is 0, these is no split and testing is done using the whole
     * input set
     */
    void train_and_test(const size_t elementCount, const size_t attributeCount, const size_t test_denominator = 0);
    const ID3Node& root() const {return _root;}
-   int classify(const size_t element) {return classify(element, _root);}
+   /** the tree that training compiled from root() */
+   const CompiledTree& compiled() const {return tree_;}
+   int classify(const size_t element) {
+      return tree_.classify([this, element](const size_t a) {return value_at(element, a);});
+   }
+   /** classes[i] becomes the class of elements[i] */
+   void classify(const uint32_t *elements, const size_t count, int *classes);
    /** recalculates the test data in root() */
    void test(const std::forward_list<size_t> &elements);
    float accuracy(const std::forward_list<size_t> &test_set) {test(test_set);return root().certainty();}
    virtual ~ID3Classifier() {}
 private:
-   int classify(const size_t element, const ID3Node &node);
-   bool test_classify(const size_t element, ID3Node &node, const int expected_class);
-   void train(std::forward_list<size_t> &elements, std::forward_list<size_t> &attributes, ID3Node &parent);
-   float entropy_of(const size_t attribute, const std::forward_list<size_t>& elements);
+   std::shared_ptr<const AttributeMatrix> matrix_; // of encode() or use_matrix()
+   std::shared_ptr<const AttributeMatrix> coded_; // that training reads: matrix_, or the codes_ of the elements
+   std::shared_ptr<ValueCodes> codes_;             // null if coded_ is matrix_
+   WorkerPool *pool_;
+   size_t parallel_threshold_;
+   Engine engine_;
+   size_t attribute_sample_;
+   unsigned sample_seed_;
+   ID3NodeTiming timing_;
+   CompiledTree tree_;
+   std::vector<uint32_t> training_; // the elements of the tree
+   std::unordered_map<const ID3Node*, ID3NodeCounts> node_counts_;
+   /** codes the elements [0,elementCount) into coded_, after those that it has */
+   void encode_codes(const size_t elementCount, const size_t attributeCount);
+   bool encoded(const size_t element) const {return matrix_ && element < matrix_->element_count();}
+   int value_at(const size_t element, const size_t attribute) {
+      return encoded(element) ? matrix_->value_of(element, attribute) : value_of(element, attribute);
+   }
+   int class_at(const size_t element) {return encoded(element) ? matrix_->class_of(element) : class_of(element);}
+};
+
+/**
+ * Classifies the elements of an encoded matrix, and no others.  The matrix is only read, so
+ * classifiers of one matrix can be trained concurrently.
+ */
+class MatrixClassifier: public ID3Classifier {
+public:
+   explicit MatrixClassifier(std::shared_ptr<const AttributeMatrix> matrix, const size_t cc = 0) : ID3Classifier(cc) {use_matrix(matrix);}
+   /** throws, as the element is not in the matrix */
+   int value_of(const size_t element, const size_t attribute) override;
+   int class_of(const size_t element) override;
 };
 
 }
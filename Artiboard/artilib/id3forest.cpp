@@ -0,0 +1,83 @@
+#include "id3forest.h"
+#include <cmath>
+
+namespace arti {
+
+ID3Forest::ID3Forest(std::shared_ptr<const AttributeMatrix> matrix, const size_t cut_off) :
+	matrix_(matrix), cut_off_(cut_off), attribute_sample_(0) {
+	ENSURE(matrix, "a forest needs an encoded matrix");
+}
+
+void ID3Forest::train(const element_index_list_t &elements, const size_t count, WorkerPool &pool, const unsigned seed) {
+	const std::vector<uint32_t> training(elements.begin(), elements.end());
+	ENSURE(!training.empty(), "elements cannot be empty");
+	const size_t attributes = matrix_->attribute_count();
+	const size_t sample = attribute_sample_ > 0 ? attribute_sample_ : std::max<size_t>(1, (size_t) std::lround(std::sqrt((double) attributes)));
+	std::vector<std::unique_ptr<CompiledTree>> trees(count);
+	pool.parallel_for(count, [&](const size_t t) {
+		std::seed_seq seq{seed, (unsigned) t};
+		std::mt19937 engine(seq);
+		std::uniform_int_distribution<size_t> pick(0, training.size() - 1);
+		std::vector<uint32_t> bootstrap(training.size());
+		for (auto &e : bootstrap)
+			e = training[pick(engine)];
+		MatrixClassifier fier(matrix_, cut_off_);
+		fier.set_pool(&pool);
+		fier.set_attribute_sample(sample, engine());
+		fier.train(bootstrap, attributes);
+		trees[t].reset(new CompiledTree(fier.compiled()));
+	});
+	trees_.clear();
+	for (auto &t : trees)
+		trees_.push_back(std::move(*t));
+}
+
+size_t ID3Forest::memory() const {
+	size_t result = 0;
+	for (auto &t : trees_)
+		result += t.memory();
+	return result;
+}
+
+int ID3Forest::classify(const size_t element) const {
+	const uint32_t e = (uint32_t) element;
+	int result;
+	classify(&e, 1, &result);
+	return result;
+}
+
+void ID3Forest::classify(const uint32_t *elements, const size_t count, int *classes) const {
+	const size_t block = 256;
+	const int limit = matrix_->class_limit();
+	std::vector<int> votes(block * limit), found(block);
+	for (size_t i = 0; i < count; i++)
+		ENSURE(elements[i] < matrix_->element_count(), "the forest can only classify the elements of its matrix");
+	for (size_t first = 0; first < count; first += block) {
+		const size_t n = std::min(block, count - first);
+		std::fill(votes.begin(), votes.end(), 0);
+		for (auto &t : trees_) {
+			t.classify(*matrix_, elements + first, n, found.data());
+			for (size_t i = 0; i < n; i++)
+				if (found[i] >= 0)
+					votes[i * limit + found[i]]++;
+		}
+		for (size_t i = 0; i < n; i++) {
+			const int * v = &votes[i * limit];
+			classes[first + i] = (int) (std::max_element(v, v + limit) - v);
+		}
+	}
+}
+
+float ID3Forest::accuracy(const element_index_list_t &elements) const {
+	const std::vector<uint32_t> test(elements.begin(), elements.end());
+	if (test.empty()) return 0;
+	std::vector<int> classes(test.size());
+	classify(test.data(), test.size(), classes.data());
+	int correct = 0;
+	for (size_t i = 0; i < test.size(); i++)
+		if (classes[i] == matrix_->class_of(test[i]))
+			correct++;
+	return (correct * 100) / (test.size() * 1.0f);
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "id3.h"
+#include <vector>
+#include <memory>
+#include <random>
+
+namespace arti {
+
+/**
+ * Bagged ID3 trees of one encoded matrix that vote on the class of an element.
+ *
+ * Every tree is trained on a bootstrap sample of the training elements (as many, drawn with
+ * replacement) and chooses the attribute of each node from a random sample of the attributes.
+ * The draws depend on the seed and the index of the tree only, so the forest does not depend on
+ * the pool that trains it.  Only the compiled trees are kept.
+ */
+class ID3Forest {
+	PREVENT_COPY(ID3Forest)
+	public:
+		explicit ID3Forest(std::shared_ptr<const AttributeMatrix> matrix, const size_t cut_off = 0);
+		/** attributes scored per node; 0, the default, is the square root of the attribute count */
+		void set_attribute_sample(const size_t count) {attribute_sample_ = count;}
+		/** replaces the trees by count trees, trained on the pool; elements must be in the matrix */
+		void train(const element_index_list_t &elements, const size_t count, WorkerPool &pool, const unsigned seed = 1);
+		size_t size() const {return trees_.size();}
+		const CompiledTree& tree(const size_t t) const {return trees_[t];}
+		/** the bytes of all compiled trees */
+		size_t memory() const;
+		/** the class with the most votes; a tie goes to the lowest class */
+		int classify(const size_t element) const;
+		/** classes[i] becomes the class of elements[i]; the trees vote on blocks of elements */
+		void classify(const uint32_t *elements, const size_t count, int *classes) const;
+		/** the percentage of elements that is classified correctly */
+		float accuracy(const element_index_list_t &elements) const;
+	private:
+		std::shared_ptr<const AttributeMatrix> matrix_;
+		const size_t cut_off_;
+		size_t attribute_sample_;
+		std::vector<CompiledTree> trees_;
+};
+
+}
@@ -0,0 +1,53 @@
+#include "id3sweep.h"
+
+namespace arti {
+
+std::size_t ID3Sweep::add_data(std::shared_ptr<const AttributeMatrix> matrix) {
+	ENSURE(matrix, "a sweep needs an encoded matrix");
+	data_.push_back(matrix);
+	return data_.size() - 1;
+}
+
+std::size_t ID3Sweep::add_fold(const element_index_list_t &training) {
+	ENSURE(!training.empty(), "a fold needs training elements");
+	folds_.push_back(Fold());
+	folds_.back().training = training;
+	return folds_.size() - 1;
+}
+
+std::size_t ID3Sweep::add_test(const std::size_t fold, const element_index_list_t &test) {
+	ENSURE(!test.empty(), "a test set cannot be empty");
+	folds_[fold].tests.push_back(test);
+	return folds_[fold].tests.size() - 1;
+}
+
+std::vector<ID3Sweep::Result> ID3Sweep::run() {
+	ENSURE(!data_.empty() && !folds_.empty() && !cut_offs_.empty(), "the grid of the sweep is empty");
+	// the results of cell c start at first[c]
+	const std::size_t cells = data_.size() * folds_.size() * cut_offs_.size();
+	std::vector<std::size_t> first(cells + 1, 0);
+	for (std::size_t c = 0; c < cells; c++) {
+		const Fold &fold = folds_[(c / cut_offs_.size()) % folds_.size()];
+		first[c + 1] = first[c] + std::max<std::size_t>(1, fold.tests.size());
+	}
+	std::vector<Result> results(first[cells]);
+	pool_.parallel_for(cells, [&](const std::size_t c) {
+		const std::size_t d = c / (folds_.size() * cut_offs_.size());
+		const std::size_t f = (c / cut_offs_.size()) % folds_.size();
+		const std::size_t cut_off = cut_offs_[c % cut_offs_.size()];
+		const Fold &fold = folds_[f];
+		MatrixClassifier fier(data_[d], cut_off);
+		fier.set_pool(&pool_);
+		Stopwatch watch;
+		element_index_list_t training(fold.training);
+		fier.train(training, data_[d]->attribute_count());
+		const double seconds = watch.seconds();
+		for (std::size_t t = 0; t < first[c + 1] - first[c]; t++) {
+			fier.test(fold.tests.empty() ? fold.training : fold.tests[t]);
+			results[first[c] + t] = {d, f, cut_off, t, fier.root().certainty(), (int) fier.root().size(), seconds};
+		}
+	});
+	return results;
+}
+
+}
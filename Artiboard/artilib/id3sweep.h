@@ -0,0 +1,51 @@
+#pragma once
+#include "id3.h"
+#include <vector>
+#include <memory>
+#include <forward_list>
+
+namespace arti {
+
+/**
+ * Trains and tests ID3 for every cell of a grid of data sets, folds and MO cut-offs.
+ *
+ * A data set is an encoded AttributeMatrix that all cells read and none change, so the cells need
+ * no client classifier and run concurrently on a WorkerPool.  A fold is a training set and the test
+ * sets that its trees are tested on; a fold without test sets is tested on its training set.  Every
+ * cell trains one tree, tests it on each test set of its fold and then discards it.
+ */
+class ID3Sweep {
+	PREVENT_COPY(ID3Sweep)
+	public:
+		/** The test of one tree on one test set; data, fold and test are in the order they were added */
+		struct Result {
+			std::size_t data;
+			std::size_t fold;
+			std::size_t cut_off;
+			std::size_t test;
+			float accuracy;
+			int size;       // of the tree
+			double seconds; // that training took
+		};
+		explicit ID3Sweep(WorkerPool &pool) : pool_(pool) {}
+		/** returns the index of the data set */
+		std::size_t add_data(std::shared_ptr<const AttributeMatrix> matrix);
+		/** returns the index of the fold */
+		std::size_t add_fold(const element_index_list_t &training);
+		/** returns the index of the test set in fold */
+		std::size_t add_test(const std::size_t fold, const element_index_list_t &test);
+		void add_cut_off(const std::size_t cut_off) {cut_offs_.push_back(cut_off);}
+		/** The results by data set, fold, cut-off and test set */
+		std::vector<Result> run();
+	private:
+		struct Fold {
+			element_index_list_t training;
+			std::vector<element_index_list_t> tests;
+		};
+		WorkerPool &pool_;
+		std::vector<std::shared_ptr<const AttributeMatrix>> data_;
+		std::vector<Fold> folds_;
+		std::vector<std::size_t> cut_offs_;
+};
+
+}
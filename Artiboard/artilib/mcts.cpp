@@ -0,0 +1,170 @@
+#include "mcts.h"
+#include "systemex.h"
+#include <cmath>
+#include <future>
+#include <thread>
+#include <algorithm>
+
+namespace arti {
+
+/* The score of outcome for the player on side */
+static float score_of(const MatchOutcome outcome, const Side side) {
+	if (outcome == SouthPlayerWins) return side == Side::South ? 1.0f : 0.0f;
+	if (outcome == NorthPlayerWins) return side == Side::North ? 1.0f : 0.0f;
+	return 0.5f;
+}
+
+PickMonteCarlo::PickMonteCarlo(const GameSpecification* spec, const int playouts, const double seconds,
+	const unsigned threads, const unsigned seed, const float exploration) :
+	spec_(spec), playouts_(playouts), seconds_limit_(seconds),
+	threads_(threads == 0 ? std::max(1U, std::thread::hardware_concurrency()) : threads),
+	seed_(seed), exploration_(exploration), playout_count_(0), seconds_(0), value_(0), total_playouts_(0), total_seconds_(0) {
+	ENSURE(playouts > 0 || seconds > 0, "Monte Carlo search needs a playout or time limit");
+}
+
+Board::u_ptr_it PickMonteCarlo::select(const Position & current, Board::u_ptr_list &children) {
+	Stopwatch watch;
+	std::vector<std::unique_ptr<Tree>> trees;
+	std::vector<std::future<int>> futures;
+	// no more trees than playouts, so that every tree gets at least one and the shares add up to playouts
+	const unsigned tree_count = playouts_ == 0 ? threads_ : std::min(threads_, (unsigned) playouts_);
+	for (unsigned t = 0; t < tree_count; t++) {
+		trees.emplace_back(new Tree(spec_, seed_, t, exploration_));
+		const int share = playouts_ == 0 ? 0 : (int) (playouts_ / tree_count + (t < playouts_ % tree_count ? 1 : 0));
+		Tree * tree = trees.back().get();
+		const double seconds = seconds_limit_;
+		if (t > 0)
+			futures.push_back(std::async(std::launch::async, [tree,&current,share,seconds]() {
+				return tree->grow(current, share, seconds);
+			}));
+		else
+			playout_count_ = tree->grow(current, share, seconds);
+	}
+	for (auto &f : futures)
+		playout_count_ += f.get();
+	seed_++;
+	std::vector<RootStats> stats;
+	for (auto &t : trees)
+		t->add_root_stats(stats);
+	seconds_ = watch.seconds();
+	total_playouts_ += playout_count_;
+	total_seconds_ += seconds_;
+	if (stats.empty())
+		return children.end();
+	ENSURE(stats.size() == children.size(), "collect_moves and collectBoards disagree");
+	std::size_t best = 0;
+	for (std::size_t i = 1; i < stats.size(); i++)
+		if (stats[i].visits > stats[best].visits)
+			best = i;
+	value_ = stats[best].visits == 0 ? 0.0f : stats[best].score / stats[best].visits;
+	auto result = children.begin();
+	std::advance(result, best);
+	return result;
+}
+
+PickMonteCarlo::Tree::Tree(const GameSpecification* spec, const unsigned seed, const unsigned stream, const float exploration) :
+	spec_(spec), exploration_(exploration) {
+	std::seed_seq seq{seed, stream};
+	engine_.seed(seq);
+}
+
+void PickMonteCarlo::Tree::expand(const int node, const Board& board, const Ply& ply) {
+	CompactMove moves[GameSpecification::max_moves];
+	const PositionThatPoints pos(ply, &board);
+	int count = 0;
+	if (spec_->outcome_of(pos) == Unknown)
+		count = spec_->collect_moves(pos, moves);
+	arena_[node].first_child = (int) arena_.size();
+	arena_[node].child_count = (unsigned char) count;
+	arena_[node].expanded = true;
+	for (int i = 0; i < count; i++)
+		arena_.push_back({moves[i], 0, 0, false, 0, 0.0f});
+}
+
+/* UCT, where unvisited children come first */
+int PickMonteCarlo::Tree::select_child(const int node) const {
+	const Node& n = arena_[node];
+	const float log_n = std::log((float) n.visits);
+	int best = -1;
+	float best_v = 0.0f;
+	for (int c = n.first_child; c < n.first_child + n.child_count; c++) {
+		const Node& child = arena_[c];
+		if (child.visits == 0)
+			return c;
+		const float v = child.score / child.visits + exploration_ * std::sqrt(log_n / child.visits);
+		if (best < 0 || v > best_v) {
+			best = c;
+			best_v = v;
+		}
+	}
+	return best;
+}
+
+MatchOutcome PickMonteCarlo::Tree::playout(Board& board, Ply ply) {
+	CompactMove moves[GameSpecification::max_moves];
+	while (true) {
+		const PositionThatPoints pos(ply, &board);
+		const MatchOutcome outcome = spec_->outcome_of(pos);
+		if (outcome != Unknown)
+			return outcome;
+		const int count = spec_->collect_moves(pos, moves);
+		if (count == 0)
+			return Draw;
+		std::uniform_int_distribution<int> pick(0, count - 1);
+		spec_->make_move(board, moves[pick(engine_)]);
+		ply = ply.next();
+	}
+}
+
+int PickMonteCarlo::Tree::grow(const Position & current, const int playouts, const double seconds) {
+	arena_.clear();
+	arena_.push_back({CompactMove(), 0, 0, false, 0, 0.0f});
+	expand(0, current.board(), current.ply());
+	Stopwatch watch;
+	std::vector<int> path;
+	int count = 0;
+	while ((playouts == 0 || count < playouts) && (seconds <= 0 || watch.seconds() < seconds)) {
+		Board board(current.board());
+		Ply ply = current.ply();
+		int node = 0;
+		path.clear();
+		path.push_back(node);
+		while (arena_[node].expanded && arena_[node].child_count > 0) {
+			node = select_child(node);
+			spec_->make_move(board, arena_[node].move);
+			ply = ply.next();
+			path.push_back(node);
+		}
+		if (!arena_[node].expanded) {
+			expand(node, board, ply);
+			if (arena_[node].child_count > 0) {
+				node = arena_[node].first_child;
+				spec_->make_move(board, arena_[node].move);
+				ply = ply.next();
+				path.push_back(node);
+			}
+		}
+		const MatchOutcome outcome = playout(board, ply);
+		arena_[0].visits++;
+		// the move into path[i] was made at the ply i-1 plies below the root
+		for (std::size_t i = 1; i < path.size(); i++) {
+			Node& n = arena_[path[i]];
+			n.visits++;
+			n.score += score_of(outcome, Ply(current.ply().index() + (int) i - 1).side_to_move());
+		}
+		count++;
+	}
+	return count;
+}
+
+void PickMonteCarlo::Tree::add_root_stats(std::vector<RootStats>& stats) const {
+	const Node& root = arena_[0];
+	if (stats.empty())
+		stats.resize(root.child_count, RootStats{0, 0.0f});
+	for (int i = 0; i < root.child_count; i++) {
+		stats[i].visits += arena_[root.first_child + i].visits;
+		stats[i].score += arena_[root.first_child + i].score;
+	}
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "game.h"
+#include <vector>
+#include <random>
+
+namespace arti {
+
+/**
+ * Monte Carlo tree search with UCT: the tree grows by one node per playout, a playout
+ * finishes the match with random moves, and the move that was visited most is chosen.
+ * It only needs the GameSpecification, so it works for any game that supports collect_moves.
+ *
+ * The nodes of a tree are kept in one arena (a vector, children next to each other) and the
+ * playouts run in place on a single Board.  With more than one thread, every thread grows its own
+ * tree (root parallel) from its own seed and the visits of the root moves are added together.
+ */
+class PickMonteCarlo: public MoveChooser {
+	public:
+		/**
+		 * Run playouts (in total, over all threads) or until seconds have passed, whichever comes first;
+		 * zero means no limit, but one of the two must be set.
+		 */
+		PickMonteCarlo(const GameSpecification* spec, const int playouts, const double seconds = 0,
+			const unsigned threads = 1, const unsigned seed = 1, const float exploration = 1.41f);
+		Board::u_ptr_it select(const Position & current, Board::u_ptr_list &children) override;
+		/** The playouts run by the previous call to select */
+		int playout_count() const {return playout_count_;}
+		/** The seconds taken by the previous call to select */
+		double seconds() const {return seconds_;}
+		/** The playouts and seconds of all calls to select */
+		long total_playouts() const {return total_playouts_;}
+		double total_seconds() const {return total_seconds_;}
+		/** The mean score (1 win, 0.5 draw, 0 loss) of the selected move for the player that made it */
+		float value() const {return value_;}
+	private:
+		struct Node {
+			CompactMove move; // that leads to this node
+			int first_child;  // index in the arena, valid when expanded
+			unsigned char child_count;
+			bool expanded;
+			int visits;
+			float score; // for the player that made move
+		};
+		/** The statistics of one root move */
+		struct RootStats {
+			int visits;
+			float score;
+		};
+		class Tree {
+			public:
+				Tree(const GameSpecification* spec, const unsigned seed, const unsigned stream, const float exploration);
+				/** Grow the tree below current; returns the playouts that were run */
+				int grow(const Position & current, const int playouts, const double seconds);
+				void add_root_stats(std::vector<RootStats>& stats) const;
+			private:
+				const GameSpecification* spec_;
+				std::mt19937 engine_;
+				const float exploration_;
+				std::vector<Node> arena_;
+				void expand(const int node, const Board& board, const Ply& ply);
+				int select_child(const int node) const;
+				MatchOutcome playout(Board& board, Ply ply);
+		};
+		const GameSpecification* spec_;
+		const int playouts_;
+		const double seconds_limit_;
+		const unsigned threads_;
+		unsigned seed_;
+		const float exploration_;
+		int playout_count_;
+		double seconds_;
+		float value_;
+		long total_playouts_;
+		double total_seconds_;
+};
+
+}
@@ -2,113 +2,313 @@
 #include "systemex.h"
 #include "log.h"
 #include <limits>
-#include <map>
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <thread>
 
 namespace arti {
 
-EvalResult PickNegamax::maximise(const Position &r, const Board::u_ptr_it child_b, const Board::u_ptr_it child_e,
-	const int depth, const int sign) {
+TranspositionTable::TranspositionTable(const std::size_t megabytes) {
+	std::size_t n = 1;
+	while (2 * n * sizeof(Slot) <= megabytes * 1024 * 1024)
+		n *= 2;
+	slots_.reset(new Slot[n]);
+	size_ = n;
+	mask_ = n - 1;
+	clear();
+}
+
+Board::hash_t TranspositionTable::key_of(const Board& board, const Ply& ply) {
+	// the same squares with the other side to move is another position
+	return ply.is_odd()?(board.hash() ^ 0x9E3779B97F4A7C15ULL):board.hash();
+}
+
+/* value in bits 0-31, depth+1 in 32-47, bound in 48-55 and best in 56-63; a used entry is never 0 */
+std::uint64_t TranspositionTable::pack(const Entry& e) {
+	std::uint32_t bits;
+	std::memcpy(&bits, &e.value, sizeof(bits));
+	return bits | ((std::uint64_t) (e.depth + 1) << 32) | ((std::uint64_t) e.bound << 48) | ((std::uint64_t) (e.best & 0xFF) << 56);
+}
+
+TranspositionTable::Entry TranspositionTable::unpack(const std::uint64_t data) {
+	Entry e;
+	const std::uint32_t bits = (std::uint32_t) data;
+	std::memcpy(&e.value, &bits, sizeof(bits));
+	e.depth = (int) ((data >> 32) & 0xFFFF) - 1;
+	e.bound = (Bound) ((data >> 48) & 0xFF);
+	e.best = (ordinal_t) (data >> 56);
+	return e;
+}
+
+void TranspositionTable::store(const Board::hash_t key, const int depth, const float value, const Bound bound, const ordinal_t best) {
+	Slot& slot = slots_[key & mask_];
+	Entry old;
+	if (probe(key, old) == Hit && old.depth > depth)
+		return;
+	const std::uint64_t data = pack({value, depth, bound, best});
+	slot.data.store(data, std::memory_order_relaxed);
+	slot.check.store(key ^ data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::clear() {
+	for (std::size_t i = 0; i < size_; i++) {
+		slots_[i].check.store(0, std::memory_order_relaxed);
+		slots_[i].data.store(0, std::memory_order_relaxed);
+	}
+}
+
+float PickNegamax::maximise(Board &board, const Ply ply, const int depth, const int sign) {
 	walk_count_++;
-	if ((depth == 0) || (child_b == child_e))
-		return {child_e, sign * function_(r)};
-	else {
-		EvalResult result { child_e, std::numeric_limits<float>::min() };
-		for (auto cit = child_b; cit != child_e; cit++) {
-			Board::u_ptr_list grand_children;
-			PositionThatPoints c(r.ply().next(), cit->get());
-			spec_->collectBoards(c, grand_children);
-			auto grand_result =  maximise(c, grand_children.begin(), grand_children.end(), depth-1, -sign);
-			grand_result.v *= -1;
-			if (result.it == child_e || grand_result.v > result.v) {
-				result.v = grand_result.v;
-				result.it = cit;
-			}
-		};
-		ASSERT(result.it != child_e);
-		return result;
+	const PositionThatPoints p(ply, &board);
+	CompactMove moves[GameSpecification::max_moves];
+	const int count = (depth == 0)?0:spec_->collect_moves(p, moves);
+	if (count == 0)
+		return sign * function_(p);
+	float best = std::numeric_limits<float>::min();
+	for (int i = 0; i < count; i++) {
+		spec_->make_move(board, moves[i]);
+		const float v = -maximise(board, ply.next(), depth-1, -sign);
+		spec_->unmake_move(board, moves[i]);
+		if (i == 0 || v > best)
+			best = v;
 	}
+	return best;
 }
 
 Board::u_ptr_it PickNegamax::select(const Position & current, Board::u_ptr_list &list) {
-	walk_count_ = 0;
+	reset_counts();
+	walk_count_ = 1;
 	const int sign = current.ply().is_odd()?-1:1;
-	auto result = maximise(current, list.begin(), list.end(), max_plies_, sign);
+	EvalResult result { list.end(), sign * function_(current) };
+	if (max_plies_ > 0)
+		for (auto cit = list.begin(); cit != list.end(); cit++) {
+			Board board(**cit);
+			const float v = -maximise(board, current.ply().next(), max_plies_-1, -sign);
+			if (result.it == list.end() || v > result.v) {
+				result.v = v;
+				result.it = cit;
+			}
+		}
 	value_ = result.v * sign;
 	return result.it;
 }
 
 
-EvalResult PickNegamaxAlphaBeta::maximise(const Position &r, const Board::u_ptr_it child_b, const Board::u_ptr_it child_e,
-	const int depth, float alpha, const float beta, const int sign) {
+float PickNegamaxAlphaBeta::maximise(Board &board, const Ply ply,
+	const int depth, float alpha, float beta, const int sign) {
 	walk_count_++;
-	if ((depth == 0) || (child_b == child_e))
-		return {child_e, sign * function_(r)};
-	else {
-		EvalResult best { child_e, std::numeric_limits<float>::min() };
-		for (auto cit = child_b; cit != child_e; cit++) {
-			Board::u_ptr_list grand_children;
-			PositionThatPoints c(r.ply().next(), cit->get());
-			spec_->collectBoards(c, grand_children);
-			if (ordered_) sort_by_function(grand_children,c.ply());
-			auto grand_result =  maximise(c, grand_children.begin(), grand_children.end(), depth-1,-beta,-alpha, -sign);
-			grand_result.v *= -1;
-			if (best.it == child_e || grand_result.v > best.v) {
-				best.v = grand_result.v;
-				best.it = cit;
-			}
-			alpha = std::max(alpha,grand_result.v);
-			if (alpha >= beta)
+	// the clock is read once every 1024 positions
+	if (abortable_ && (out_of_nodes() || ((walk_count_ & 0x3FF) == 0 && out_of_time())))
+		aborted_ = true;
+	if (stop_ && stop_->load(std::memory_order_relaxed))
+		aborted_ = true;
+	if (aborted_)
+		return 0.0f;
+	const PositionThatPoints p(ply, &board);
+	CompactMove moves[GameSpecification::max_moves];
+	const int count = (depth == 0)?0:spec_->collect_moves(p, moves);
+	if (count == 0)
+		return sign * function_(p);
+	TranspositionTable::Entry entry;
+	Board::hash_t key = 0;
+	ordinal_t hint = TranspositionTable::no_move;
+	if (table_) {
+		key = TranspositionTable::key_of(board, ply);
+		switch (table_->probe(key, entry)) {
+			case TranspositionTable::Hit:
+				hit_count_++;
+				hint = entry.best;
+				if (entry.depth >= depth) {
+					if (entry.bound == TranspositionTable::Exact)
+						return entry.value;
+					else if (entry.bound == TranspositionTable::LowerBound)
+						alpha = std::max(alpha, entry.value);
+					else
+						beta = std::min(beta, entry.value);
+					if (alpha >= beta)
+						return entry.value;
+				}
 				break;
-		};
-		ASSERT(best.it != child_e);
-		return best;
+			case TranspositionTable::Miss: miss_count_++; break;
+			case TranspositionTable::Collision: collision_count_++; break;
+		}
 	}
+	// the moves are searched in this order; the table keeps their index in moves
+	int order[GameSpecification::max_moves];
+	for (int i = 0; i < count; i++)
+		order[i] = i;
+	int first = 0;
+	if (hint < count) {
+		// search the best move of the table first, the others keep their order
+		for (int j = hint; j > 0; j--) order[j] = order[j-1];
+		order[0] = hint;
+		first = 1;
+	}
+	if (ordered_) sort_by_function(board, moves, order + first, count - first, ply);
+	const float searched_alpha = alpha;
+	float best = std::numeric_limits<float>::min();
+	int best_i = 0;
+	for (int i = 0; i < count; i++) {
+		CompactMove &m = moves[order[i]];
+		spec_->make_move(board, m);
+		const float v = -maximise(board, ply.next(), depth-1, -beta, -alpha, -sign);
+		spec_->unmake_move(board, m);
+		if (aborted_)
+			return 0.0f;
+		if (i == 0 || v > best) {
+			best = v;
+			best_i = i;
+		}
+		if (best >= beta)
+			break;
+		alpha = std::max(alpha,v);
+	}
+	if (table_) {
+		const auto bound = (best <= searched_alpha)?TranspositionTable::UpperBound:
+			(best >= beta)?TranspositionTable::LowerBound:TranspositionTable::Exact;
+		table_->store(key, depth, best, bound, (ordinal_t) order[best_i]);
+	}
+	return best;
+}
+
+EvalResult PickNegamaxAlphaBeta::search_root(const Position & current, std::vector<RootMove>& order, const int depth, const int sign) {
+	EvalResult result { order.front().it, 0.0f };
+	bool first = true;
+	float alpha = std::numeric_limits<float>::min();
+	const float beta = std::numeric_limits<float>::max();
+	for (auto &m : order) {
+		Board board(**m.it);
+		m.v = -maximise(board, current.ply().next(), depth-1, -beta, -alpha, -sign);
+		if (aborted_)
+			break;
+		if (first || m.v > result.v) {
+			result.v = m.v;
+			result.it = m.it;
+			first = false;
+		}
+		alpha = std::max(alpha,m.v);
+		if (alpha >= beta)
+			break;
+	}
+	return result;
 }
 
 Board::u_ptr_it PickNegamaxAlphaBeta::select(const Position & current, Board::u_ptr_list &list) {
-	walk_count_ = 0;
+	reset_counts();
+	walk_count_ = 1;
+	aborted_ = false;
+	abortable_ = false;
+	depth_reached_ = 0;
 	const int sign = current.ply().is_odd()?-1:1;
-	auto result = maximise(current, list.begin(), list.end(), max_plies_,
-		std::numeric_limits<float>::min(),
-		std::numeric_limits<float>::max(), sign);
+	if (max_plies_ == 0 || list.empty()) {
+		value_ = function_(current);
+		return list.end();
+	}
+	std::vector<RootMove> order;
+	for (auto cit = list.begin(); cit != list.end(); cit++)
+		order.push_back({cit, 0.0f});
+	if (time_budget_ <= 0 && node_budget_ <= 0) {
+		auto result = search_root(current, order, max_plies_, sign);
+		depth_reached_ = max_plies_;
+		value_ = result.v * sign;
+		return result.it;
+	}
+	watch_.restart();
+	auto * const table = table_;
+	if (!table_) {
+		if (!own_table_) own_table_.reset(new TranspositionTable(4));
+		table_ = own_table_.get();
+	}
+	EvalResult result { list.end(), 0.0f };
+	for (int depth = 1; depth <= max_plies_; depth++) {
+		abortable_ = depth > 1;
+		auto r = search_root(current, order, depth, sign);
+		if (aborted_)
+			break;
+		result = r;
+		depth_reached_ = depth;
+		std::stable_sort(order.begin(), order.end(), [](const RootMove& a, const RootMove& b) {return a.v > b.v;});
+		if (out_of_nodes() || out_of_time())
+			break;
+	}
+	table_ = table;
+	abortable_ = false;
 	value_ = result.v * sign;
 	return result.it;
 }
 
-/* A better function has a greater value for the better board to play at the ply */
-struct BetterThanFnFunctor {
-		const eval_function_t fn_;
-		const Ply parent_ply;
-		std::map<const Board*,float> values_;
-		float operator()(const Board * b) {
-			auto fit = values_.find(b);
-			float v = 0.0f;
-			if (fit != values_.end()) 
-				v = fit->second;
-			else {
-				v = fn_(PositionThatPoints(parent_ply.next(),b));
-				if (!parent_ply.is_odd())
-					v = -v;
-				values_.emplace(b,v);
-			}
-			return v;
-		}				
-};
-
-struct LessThanFnComparer {		
-		BetterThanFnFunctor& fn_;
-		bool operator()(const Board::u_ptr& a, const Board::u_ptr& b) {
-			const auto av = fn_(a.get());
-			const auto bv = fn_(b.get());
-			return av < bv;
-		}
-};
+PickParallelNegamax::PickParallelNegamax(const GameSpecification* spec, eval_function_t fn, int ply, unsigned threads,
+	const std::size_t megabytes, bool ordered) :
+	MinimaxChooser(spec,fn,ply), ordered_(ordered), threads_(threads), table_(megabytes) {
+	if (threads_ == 0)
+		threads_ = std::max(1U, std::thread::hardware_concurrency());
+}
 
+Board::u_ptr_it PickParallelNegamax::select(const Position & current, Board::u_ptr_list &list) {
+	reset_counts();
+	std::atomic<bool> stop(false);
+	std::vector<Board::u_ptr_list> lists(threads_ - 1);
+	std::vector<std::unique_ptr<PickNegamaxAlphaBeta>> helpers;
+	std::vector<std::future<void>> futures;
+	for (unsigned i = 1; i < threads_; i++) {
+		Board::u_ptr_list * helper_list = &lists[i-1];
+		for (auto &b : list)
+			helper_list->emplace_back(new Board(*b));
+		for (unsigned r = 0; !list.empty() && r < i % list.size(); r++)
+			helper_list->splice(helper_list->end(), *helper_list, helper_list->begin());
+		PickNegamaxAlphaBeta * helper = new PickNegamaxAlphaBeta(spec_, function_, max_plies_ + (i % 2), ordered_);
+		helpers.emplace_back(helper);
+		helper->set_table(&table_);
+		helper->set_stop(&stop);
+		futures.push_back(std::async(std::launch::async, [helper,helper_list,&current]() {
+			helper->select(current, *helper_list);
+		}));
+	}
+	PickNegamaxAlphaBeta main(spec_, function_, max_plies_, ordered_);
+	main.set_table(&table_);
+	auto result = main.select(current, list);
+	stop = true;
+	for (auto &f : futures)
+		f.get();
+	auto add_counts = [this](const MinimaxChooser& c) {
+		thread_walk_counts_.push_back(c.walk_count());
+		walk_count_ += c.walk_count();
+		hit_count_ += c.hit_count();
+		miss_count_ += c.miss_count();
+		collision_count_ += c.collision_count();
+	};
+	thread_walk_counts_.clear();
+	add_counts(main);
+	for (auto &h : helpers)
+		add_counts(*h);
+	value_ = main.value();
+	return result;
+}
 
-void PickNegamaxAlphaBeta::sort_by_function(Board::u_ptr_list& boards, const Ply parent_ply) const {
-	BetterThanFnFunctor bt{function_, parent_ply};
-	LessThanFnComparer compare{bt};
-	boards.sort(compare);
+/* 
+ * A better move has a greater function value for the board it leads to at the ply.
+ * The insertion sort is stable, so moves of equal value stay in the order of the specification.
+ */
+void PickNegamaxAlphaBeta::sort_by_function(Board &board, CompactMove * moves, int * order, const int count, const Ply parent_ply) const {
+	float values[GameSpecification::max_moves];
+	for (int i = 0; i < count; i++) {
+		spec_->make_move(board, moves[order[i]]);
+		const float v = function_(PositionThatPoints(parent_ply.next(), &board));
+		spec_->unmake_move(board, moves[order[i]]);
+		values[i] = parent_ply.is_odd()?v:-v;
+	}
+	for (int i = 1; i < count; i++) {
+		const float v = values[i];
+		const int m = order[i];
+		int j = i;
+		for (; j > 0 && v < values[j-1]; j--) {
+			values[j] = values[j-1];
+			order[j] = order[j-1];
+		}
+		values[j] = v;
+		order[j] = m;
+	}
 }
 
 }
@@ -1,7 +1,57 @@
 #include "game.h"
+#include <vector>
+#include <atomic>
 
 namespace arti {
 
+/**
+ * A fixed size table of search results, indexed by the hash of the board and the parity of the ply.
+ * An entry remembers the depth of the search below it, whether the value is exact or a bound,
+ * and the index of the best move in the moves of the position.  A new result replaces the entry
+ * of another position, or an entry of the same position that was searched less deep.
+ *
+ * Threads can share a table without locks: a slot holds the entry packed into one word and that
+ * word xor the key in another, so a slot that is torn by concurrent stores reads as a collision.
+ */
+class TranspositionTable {
+	public:
+		enum Bound : unsigned char { Exact, LowerBound, UpperBound };
+		enum Probe { Hit, Miss, Collision };
+		static const ordinal_t no_move = 0xFF;
+		struct Entry {
+			float value;
+			int depth;
+			Bound bound;
+			ordinal_t best; // the index of the best move in the moves that collect_moves gives the position, or no_move
+		};
+		/** Use at most megabytes of memory; the number of entries is a power of two */
+		explicit TranspositionTable(const std::size_t megabytes = 16);
+		static Board::hash_t key_of(const Board& board, const Ply& ply);
+		/** Sets entry when the slot of key holds key */
+		Probe probe(const Board::hash_t key, Entry& entry) const {
+			const Slot& slot = slots_[key & mask_];
+			const std::uint64_t data = slot.data.load(std::memory_order_relaxed);
+			const std::uint64_t check = slot.check.load(std::memory_order_relaxed);
+			if (data == 0) return Miss;
+			if ((check ^ data) != key) return Collision;
+			entry = unpack(data);
+			return Hit;
+		}
+		void store(const Board::hash_t key, const int depth, const float value, const Bound bound, const ordinal_t best);
+		void clear();
+		std::size_t size() const {return size_;}
+	private:
+		struct Slot {
+			std::atomic<std::uint64_t> check; // key ^ data
+			std::atomic<std::uint64_t> data;  // 0 when unused
+		};
+		static std::uint64_t pack(const Entry& e);
+		static Entry unpack(const std::uint64_t data);
+		std::unique_ptr<Slot[]> slots_;
+		std::size_t size_;
+		Board::hash_t mask_;
+};
+
 struct EvalResult {
 		Board::u_ptr_it it;
 		float v;
@@ -14,18 +64,31 @@ protected:
 		int max_plies_;
 		int walk_count_;
 		float value_;
+		int hit_count_, miss_count_, collision_count_;
 protected:
-		MinimaxChooser(const GameSpecification* spec, eval_function_t fn, int ply) : spec_(spec), function_(fn), max_plies_(ply), walk_count_(0), value_(0.0f) {};
+		MinimaxChooser(const GameSpecification* spec, eval_function_t fn, int ply) : spec_(spec), function_(fn), max_plies_(ply), walk_count_(0), value_(0.0f),
+			hit_count_(0), miss_count_(0), collision_count_(0) {};
+		void reset_counts() {walk_count_ = hit_count_ = miss_count_ = collision_count_ = 0;}
 public:
 		/** The number of positions traversed by the chooser during the previous call to select */
 		int walk_count() const {return walk_count_;}
+		/** Transposition table probes during the previous call to select that found the position */
+		int hit_count() const {return hit_count_;}
+		/** Transposition table probes during the previous call to select that found an unused entry */
+		int miss_count() const {return miss_count_;}
+		/** Transposition table probes during the previous call to select that found another position */
+		int collision_count() const {return collision_count_;}
 		/** The value of the root calculated by the chooser during the previous call to select */
 		float value() const {return value_;}
 };
 
+/**
+ * The choosers search below the root on a single Board, using make_move and unmake_move
+ * of the GameSpecification, so that there is no allocation per node.
+ */
 class PickNegamax: public MinimaxChooser {
 	private:
-		EvalResult maximise(const Position &p, const Board::u_ptr_it child_b, const Board::u_ptr_it child_e, const int depth, const int sign);
+		float maximise(Board &board, const Ply ply, const int depth, const int sign);
 	public:
 		PickNegamax(GameSpecification* spec, eval_function_t fn, int ply) :
 			MinimaxChooser(spec,fn,ply) {};
@@ -35,17 +98,73 @@ class PickNegamax: public MinimaxChooser {
 class PickNegamaxAlphaBeta: public MinimaxChooser {
 	private:
 		bool ordered_;
-		EvalResult maximise(const Position &p, const Board::u_ptr_it child_b, const Board::u_ptr_it child_e,
-			const int depth, float alpha, const float beta,
+		TranspositionTable * table_;
+		std::unique_ptr<TranspositionTable> own_table_;
+		double time_budget_;
+		int node_budget_;
+		int depth_reached_;
+		bool abortable_, aborted_;
+		const std::atomic<bool> * stop_;
+		Stopwatch watch_;
+		struct RootMove {
+			Board::u_ptr_it it;
+			float v;
+		};
+		float maximise(Board &board, const Ply ply,
+			const int depth, float alpha, float beta,
 			const int sign);
-		void sort_by_function(Board::u_ptr_list& boards, const Ply parent_ply) const;
+		EvalResult search_root(const Position & current, std::vector<RootMove>& order, const int depth, const int sign);
+		bool out_of_nodes() const {return node_budget_ > 0 && walk_count_ >= node_budget_;}
+		bool out_of_time() const {return time_budget_ > 0 && watch_.seconds() >= time_budget_;}
+		/** sorts order, the indices of moves, best move first */
+		void sort_by_function(Board &board, CompactMove * moves, int * order, const int count, const Ply parent_ply) const;
 	public:
 		/** The value for ply indicates how many ply must be searched.  The minimum value is 1. At ply=1
 		 * there is essentially no look ahead - the function fn is determines the choice.
 		 */
 		PickNegamaxAlphaBeta(const GameSpecification* spec, eval_function_t fn, int ply, bool ordered=true) :
-			MinimaxChooser(spec,fn,ply),  ordered_(ordered) {
+			MinimaxChooser(spec,fn,ply),  ordered_(ordered), table_(nullptr),
+			time_budget_(0), node_budget_(0), depth_reached_(0), abortable_(false), aborted_(false), stop_(nullptr) {
 		};
+		/** Use table (owned by the caller) for cutoffs and move ordering; nullptr searches without one */
+		void set_table(TranspositionTable * table) {table_ = table;}
+		/**
+		 * Search iteratively deeper, one ply at a time up to ply, until seconds or nodes (positions walked) run out;
+		 * zero means no limit, and no limits at all turns iterative deepening off.
+		 * Each depth searches the root moves in the order of the values of the previous depth, and the
+		 * transposition table (a private one when none is set) orders the moves below the root.
+		 * The move of the last completed depth is selected; depth 1 always completes.
+		 */
+		void set_budget(const double seconds, const int nodes = 0) {time_budget_ = seconds; node_budget_ = nodes;}
+		/** The depth of the search that selected the move during the previous call to select */
+		int depth_reached() const {return depth_reached_;}
+		/** Abandon the search as soon as *stop is true; the selected move is then meaningless */
+		void set_stop(const std::atomic<bool> * stop) {stop_ = stop;}
+		Board::u_ptr_it select(const Position & current, Board::u_ptr_list &list) override;
+};
+
+/**
+ * Searches a move on all cores with Lazy SMP: every thread runs a PickNegamaxAlphaBeta on the
+ * same root and they share one TranspositionTable.  The helper threads start from rotated root
+ * moves, and every other one searches a ply deeper, so that they fill the table ahead of the main
+ * search.  The move and value are those of the main search; the helpers stop when it completes.
+ * The main search uses the deeper results of the helpers, so the value can differ from (improve on)
+ * that of a single search to the same depth.
+ */
+class PickParallelNegamax: public MinimaxChooser {
+	private:
+		bool ordered_;
+		unsigned threads_;
+		TranspositionTable table_;
+		std::vector<int> thread_walk_counts_;
+	public:
+		/** threads = 0 uses a thread for each core */
+		PickParallelNegamax(const GameSpecification* spec, eval_function_t fn, int ply, unsigned threads = 0,
+			const std::size_t megabytes = 16, bool ordered = true);
+		unsigned threads() const {return threads_;}
+		/** The positions walked by each thread during the previous call to select, the main search first */
+		const std::vector<int>& thread_walk_counts() const {return thread_walk_counts_;}
+		void clear_table() {table_.clear();}
 		Board::u_ptr_it select(const Position & current, Board::u_ptr_list &list) override;
 };
 
@@ -0,0 +1,239 @@
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "outcomecache.h"
+#include "log.h"
+
+namespace arti {
+
+struct OutcomeCache::Header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t row_size;      // the rows are read as OutcomeRow objects
+	std::uint64_t source_size;
+	std::uint64_t source_checksum; // of the contents of the source
+	std::uint64_t rows;
+	std::uint64_t pieces;        // the (square, piece) pairs of the statistics
+	std::uint64_t encoding;      // the offset of the Encoding, 0 if there is none
+	std::uint64_t checksum;      // of the bytes after the header
+};
+
+struct OutcomeCache::Encoding {
+	char name[48];
+	std::uint64_t fingerprint;   // of the table that was encoded
+	std::uint32_t attributes;
+	std::uint32_t elements;      // followed by the classes and then the column of every attribute
+};
+
+namespace {
+	const char magic[8] = {'A','R','T','I','R','O','W','S'};
+	const std::size_t outcome_count = 4; // MatchOutcome
+	const std::size_t header_size = 64;
+
+	std::size_t padded(const std::size_t n) {return (n + 7) & ~(std::size_t) 7;}
+
+	std::uint64_t checksum(const char *p, const std::size_t n) {
+		std::uint64_t result = n;
+		std::size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			std::uint64_t w;
+			memcpy(&w, p + i, 8);
+			result = (result ^ w) * 0x9E3779B97F4A7C15ULL;
+			result ^= result >> 29;
+		}
+		for (; i < n; i++)
+			result = (result ^ (unsigned char) p[i]) * 0x100000001b3ULL;
+		return result;
+	}
+
+	/** by contents, as a source that is written again within a second can keep its size and time */
+	void identify(const std::string &source, std::uint64_t &size, std::uint64_t &sum) {
+		const MappedFile file(source);
+		size = file.size();
+		sum = checksum(file.data(), file.size());
+	}
+
+	template <class T> void append(std::vector<char> &image, const T *p, const std::size_t count) {
+		const char * c = reinterpret_cast<const char *>(p);
+		image.insert(image.end(), c, c + count * sizeof(T));
+	}
+
+	/** a name next to file_name that no other process writes */
+	std::string temporary_name(const std::string &file_name) {
+#ifdef _WIN32
+		const int pid = _getpid();
+#else
+		const int pid = getpid();
+#endif
+		std::ostringstream result;
+		result << file_name << "." << pid << ".tmp";
+		return result.str();
+	}
+
+	/** replaces target by source in one step, so that a reader sees the old or the new file */
+	bool replace(const std::string &source, const std::string &target) {
+#ifdef _WIN32
+		return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+	}
+
+	/** where the outcome counts start, after the header and the rows */
+	std::size_t counts_offset(const std::uint64_t rows) {return padded(header_size + rows * sizeof(OutcomeRow));}
+}
+
+OutcomeCache::OutcomeCache(const std::string &source, const std::string &file_name, read_fn_t read_source) :
+	source_(source), file_name_(file_name), written_(false) {
+	static_assert(sizeof(Header) == header_size && sizeof(Encoding) == 64, "the sections of an image are 8 byte aligned");
+	if (open()) return;
+	const outcome_rows_t rows = read_source();
+	OutcomeData data;
+	data.add_rows(rows);
+	ENSURE(data.size() == rows.size(), "the rows of a cache cannot repeat a board");
+	const OutcomeStats stats = OutcomeProfile(rows.data(), rows.data() + rows.size()).stats();
+	std::vector<char> image(sizeof(Header));
+	append(image, rows.data(), rows.size());
+	image.resize(padded(image.size()));
+	std::int64_t counts[outcome_count] = {};
+	for (const auto &e : stats.outcome_counts())
+		counts[e.first] = e.second;
+	append(image, counts, outcome_count);
+	std::vector<char> pieces;
+	for (const auto &e : stats.square_pieces())
+		for (const auto &p : e.second) {
+			pieces.push_back((char) e.first.index());
+			pieces.push_back(p.index());
+		}
+	append(image, pieces.data(), pieces.size());
+	image.resize(padded(image.size()));
+	Header h;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, magic, sizeof magic);
+	h.version = version;
+	h.row_size = sizeof(OutcomeRow);
+	identify(source_, h.source_size, h.source_checksum);
+	h.rows = rows.size();
+	h.pieces = pieces.size() / 2;
+	h.checksum = checksum(image.data() + sizeof h, image.size() - sizeof h);
+	memcpy(image.data(), &h, sizeof h);
+	write(image);
+	written_ = true;
+}
+
+OutcomeCache::~OutcomeCache() {}
+
+const OutcomeCache::Header& OutcomeCache::header() const {
+	return *reinterpret_cast<const Header *>(data());
+}
+
+const OutcomeCache::Encoding * OutcomeCache::encoding() const {
+	const auto offset = header().encoding;
+	return offset == 0 ? nullptr : reinterpret_cast<const Encoding *>(data() + offset);
+}
+
+std::size_t OutcomeCache::size() const {
+	return (std::size_t) header().rows;
+}
+
+const OutcomeRow * OutcomeCache::begin() const {
+	return reinterpret_cast<const OutcomeRow *>(data() + sizeof(Header));
+}
+
+OutcomeStats OutcomeCache::stats() const {
+	const std::size_t offset = counts_offset(header().rows);
+	const std::int64_t * counts = reinterpret_cast<const std::int64_t *>(data() + offset);
+	outcome_counts_t outcomes;
+	for (std::size_t o = 0; o < outcome_count; o++)
+		if (counts[o] > 0)
+			outcomes[(MatchOutcome) o] = (long) counts[o];
+	const char * pieces = data() + offset + outcome_count * sizeof(std::int64_t);
+	square_pieces_t square_pieces;
+	for (std::size_t i = 0; i < header().pieces; i++)
+		square_pieces[Square::from_index(pieces[2 * i])].insert(Piece(pieces[2 * i + 1]));
+	return OutcomeStats((long) size(), outcomes, square_pieces);
+}
+
+std::shared_ptr<AttributeMatrix> OutcomeCache::matrix(const std::string &encoding, const std::uint64_t fingerprint) const {
+	const Encoding * e = this->encoding();
+	if (!e || encoding != e->name || fingerprint != e->fingerprint)
+		return nullptr;
+	std::shared_ptr<AttributeMatrix> result(new AttributeMatrix(e->elements, e->attributes));
+	const std::uint8_t * classes = reinterpret_cast<const std::uint8_t *>(e + 1);
+	result->fill(classes + e->elements, classes);
+	return result;
+}
+
+void OutcomeCache::store(const std::string &encoding, const std::uint64_t fingerprint, const AttributeMatrix &matrix) {
+	Encoding e;
+	memset(&e, 0, sizeof e);
+	ENSURE(encoding.size() < sizeof e.name, "the name of an encoding is too long");
+	memcpy(e.name, encoding.c_str(), encoding.size());
+	e.fingerprint = fingerprint;
+	e.attributes = (std::uint32_t) matrix.attribute_count();
+	e.elements = (std::uint32_t) matrix.element_count();
+	// keep the rows and statistics, and replace the encoding
+	const std::size_t kept = header().encoding == 0 ? data_size() : (std::size_t) header().encoding;
+	std::vector<char> image(data(), data() + kept);
+	append(image, &e, 1);
+	append(image, matrix.classes(), e.elements);
+	for (std::size_t a = 0; a < e.attributes; a++)
+		append(image, matrix.column(a), e.elements);
+	Header &h = *reinterpret_cast<Header *>(image.data());
+	h.encoding = kept;
+	h.checksum = checksum(image.data() + sizeof h, image.size() - sizeof h);
+	write(image);
+}
+
+bool OutcomeCache::open() {
+	try {
+		file_.reset(new MappedFile(file_name_));
+	} catch (const runtime_error &) {
+		return false;
+	}
+	std::uint64_t source_size, source_checksum;
+	identify(source_, source_size, source_checksum);
+	bool valid = data_size() >= sizeof(Header);
+	if (valid) {
+		const Header &h = header();
+		const std::size_t stats_end = padded(counts_offset(h.rows) + outcome_count * sizeof(std::int64_t) + 2 * h.pieces);
+		valid = memcmp(h.magic, magic, sizeof magic) == 0 && h.version == version && h.row_size == sizeof(OutcomeRow)
+			&& h.source_size == source_size && h.source_checksum == source_checksum && data_size() >= stats_end
+			&& (h.encoding == 0 ? data_size() == stats_end : h.encoding == stats_end && data_size() >= stats_end + sizeof(Encoding))
+			&& checksum(data() + sizeof h, data_size() - sizeof h) == h.checksum;
+		if (valid && h.encoding != 0) {
+			const Encoding * e = encoding();
+			valid = data_size() == stats_end + sizeof(Encoding) + (std::size_t) e->elements * (e->attributes + 1);
+		}
+	}
+	if (!valid)
+		file_.reset();
+	return valid;
+}
+
+void OutcomeCache::write(std::vector<char> &image) {
+	file_.reset();
+	image_.clear();
+	const std::string temporary = temporary_name(file_name_);
+	bool written;
+	{
+		std::ofstream out(temporary, std::ios::binary);
+		out.write(image.data(), image.size());
+		out.close();
+		written = !out.fail();
+	}
+	if (!written || !replace(temporary, file_name_) || !open()) {
+		std::remove(temporary.c_str());
+		LOG << "could not write the cache " << file_name_ << "; it is kept in memory";
+		image_.swap(image);
+	}
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include "outcomedata.h"
+
+namespace arti {
+
+/**
+ * A binary image of the rows of a data file, with their statistics and, optionally, one encoding
+ * of them as attribute columns.  The image is a file that is mapped into memory and read in place:
+ * the rows are the OutcomeRow objects themselves, so opening it takes no parsing, and processes
+ * that open the same image share its pages.
+ *
+ * The header holds a version, the size of a row, the size and a checksum of the contents of the
+ * source file and a checksum of everything after the header.  If any of them does not match, the image is
+ * written again from the source.  An image that cannot be written is kept in memory.
+ */
+class OutcomeCache {
+	PREVENT_COPY(OutcomeCache)
+	public:
+		typedef std::function<outcome_rows_t ()> read_fn_t;
+		static const std::uint32_t version = 2;
+		/** opens the image file_name of source; read_source reads rows without duplicate boards */
+		OutcomeCache(const std::string &source, const std::string &file_name, read_fn_t read_source);
+		~OutcomeCache();
+		/** the image was written when it was opened */
+		bool written() const {return written_;}
+		std::size_t size() const;
+		const OutcomeRow * begin() const;
+		const OutcomeRow * end() const {return begin() + size();}
+		OutcomeStats stats() const;
+		/**
+		 * the matrix that store() kept for encoding and a table with this fingerprint; null if there
+		 * is none.  The columns are copied into the matrix
+		 */
+		std::shared_ptr<AttributeMatrix> matrix(const std::string &encoding, const std::uint64_t fingerprint) const;
+		/** writes the image again, with the matrix as its encoding */
+		void store(const std::string &encoding, const std::uint64_t fingerprint, const AttributeMatrix &matrix);
+	private:
+		struct Header;
+		struct Encoding;
+		const std::string source_;
+		const std::string file_name_;
+		std::unique_ptr<MappedFile> file_;
+		std::vector<char> image_; // if the image could not be written
+		bool written_;
+		const char * data() const {return file_ ? file_->data() : image_.data();}
+		std::size_t data_size() const {return file_ ? file_->size() : image_.size();}
+		const Header& header() const;
+		const Encoding * encoding() const;
+		bool open();
+		void write(std::vector<char> &image);
+};
+
+}
@@ -1,18 +1,10 @@
+#include <future>
+#include <thread>
+#include <algorithm>
 #include "outcomedata.h"
 #include "log.h"
 namespace arti {
-OutcomeStats::OutcomeStats(const outcome_map_t &data) {
-	size_ = data.size();
-	for (auto &e : data) {
-		outcomes_[e.second]++;
-		e.first.apply(
-			[&](Square s, Piece p) {
-				if (!p.is_empty())
-					square_pieces_[s].insert(p);
-		}
-		);
-	}
-}
+OutcomeStats::OutcomeStats(const outcome_map_t &data) : OutcomeStats(OutcomeProfile(data).stats()) {}
 
 std::vector<Piece> OutcomeStats::pieces() const {
 	std::set<Piece> t;
@@ -39,17 +31,193 @@ std::vector<Square> OutcomeStats::squares() const {
 }
 
 
+namespace {
+	// the rows of a map are pairs of a const board, which do not bind to a board_outcome_t
+	const Board& board_of(const outcome_map_t::value_type &row) {return row.first;}
+	const Board& board_of(const board_outcome_t &row) {return row.first;}
+	const CompactBoard& board_of(const OutcomeRow &row) {return row.board;}
+	MatchOutcome outcome_of(const outcome_map_t::value_type &row) {return row.second;}
+	MatchOutcome outcome_of(const board_outcome_t &row) {return row.second;}
+	MatchOutcome outcome_of(const OutcomeRow &row) {return row.outcome;}
+}
+
+OutcomeProfile::OutcomeProfile(const outcome_map_t &data, const std::vector<Region> &regions, const std::vector<Piece> &pieces,
+	const Piece &blank, const unsigned threads) : regions_(regions), profiled_(pieces), blank_(blank) {
+	count(data.begin(), data.end(), data.size(), threads);
+}
+
+OutcomeProfile::OutcomeProfile(const board_outcomes_t &rows, const std::vector<Region> &regions, const std::vector<Piece> &pieces,
+	const Piece &blank, const unsigned threads) : regions_(regions), profiled_(pieces), blank_(blank) {
+	count(rows.begin(), rows.end(), rows.size(), threads);
+}
+
+OutcomeProfile::OutcomeProfile(const OutcomeRow *first, const OutcomeRow *last, const std::vector<Region> &regions, const std::vector<Piece> &pieces,
+	const Piece &blank, const unsigned threads) : regions_(regions), profiled_(pieces), blank_(blank) {
+	count(first, last, last - first, threads);
+}
+
+template <class It> void OutcomeProfile::count(It first, It last, const std::size_t n, const unsigned threads) {
+	const std::size_t region_count = regions_.size();
+	const std::size_t piece_count = profiled_.size();
+	const std::size_t occupancy_size = region_count * piece_count * (square_count + 1) * outcome_values;
+	// the profiled piece of every value, -1 for the others
+	std::array<int, 256> slot;
+	slot.fill(-1);
+	for (std::size_t p = 0; p < piece_count; p++)
+		slot[(unsigned char) profiled_[p].index()] = (int) p;
+	struct Counts {
+		std::array<long, outcome_values> outcomes;
+		std::vector<long> pieces, plies, occupancy;
+	};
+	auto count_range = [&](It b, It e, Counts &c) {
+		c.outcomes.fill(0);
+		c.pieces.assign(square_count * 256, 0);
+		c.plies.assign((square_count + 1) * outcome_values, 0);
+		c.occupancy.assign(occupancy_size, 0);
+		std::vector<square_mask_t> masks(piece_count);
+		for (; b != e; ++b) {
+			const auto &board = board_of(*b);
+			const int o = outcome_of(*b);
+			c.outcomes[o]++;
+			std::fill(masks.begin(), masks.end(), 0);
+			int ply = 0;
+			for (int i = 0; i < square_count; i++) {
+				const Piece p = board.at(i % 8, i / 8);
+				const unsigned char v = (unsigned char) p.index();
+				c.pieces[i * 256 + v]++;
+				if (!p.is_empty() && p != blank_) ply++;
+				if (slot[v] >= 0) masks[slot[v]] |= square_mask_t(1) << i;
+			}
+			c.plies[ply * outcome_values + o]++;
+			for (std::size_t r = 0; r < region_count; r++)
+				for (std::size_t p = 0; p < piece_count; p++)
+					c.occupancy[((r * piece_count + p) * (square_count + 1) + popcount(masks[p] & regions_[r].mask())) * outcome_values + o]++;
+		}
+	};
+	// range k holds the rows from k*n/ranges on; a range gets at least 4096 rows
+	const std::size_t cores = threads == 0 ? std::max(1U, std::thread::hardware_concurrency()) : threads;
+	const std::size_t ranges = std::max<std::size_t>(1, std::min<std::size_t>(cores, n / 4096));
+	std::vector<It> starts(1, first);
+	for (std::size_t k = 1; k < ranges; k++) {
+		It s = starts.back();
+		std::advance(s, k * n / ranges - (k - 1) * n / ranges);
+		starts.push_back(s);
+	}
+	starts.push_back(last);
+	std::vector<Counts> counts(ranges);
+	std::vector<std::future<void>> futures;
+	for (std::size_t k = 1; k < ranges; k++)
+		futures.push_back(std::async(std::launch::async, [&, k]() {count_range(starts[k], starts[k + 1], counts[k]);}));
+	count_range(starts[0], starts[1], counts[0]);
+	for (auto &f : futures)
+		f.get();
+	size_ = (long) n;
+	outcomes_ = counts[0].outcomes;
+	pieces_.swap(counts[0].pieces);
+	plies_.swap(counts[0].plies);
+	occupancy_.swap(counts[0].occupancy);
+	for (std::size_t k = 1; k < ranges; k++) {
+		for (int o = 0; o < outcome_values; o++)
+			outcomes_[o] += counts[k].outcomes[o];
+		std::transform(pieces_.begin(), pieces_.end(), counts[k].pieces.begin(), pieces_.begin(), std::plus<long>());
+		std::transform(plies_.begin(), plies_.end(), counts[k].plies.begin(), plies_.begin(), std::plus<long>());
+		std::transform(occupancy_.begin(), occupancy_.end(), counts[k].occupancy.begin(), occupancy_.begin(), std::plus<long>());
+	}
+}
+
+long OutcomeProfile::ply_count(const int ply) const {
+	long result = 0;
+	for (int o = 0; o < outcome_values; o++)
+		result += ply_count(ply, (MatchOutcome) o);
+	return result;
+}
+
+long OutcomeProfile::occupancy(const std::size_t r, const std::size_t p, const int count) const {
+	long result = 0;
+	for (int o = 0; o < outcome_values; o++)
+		result += occupancy(r, p, count, (MatchOutcome) o);
+	return result;
+}
+
+OutcomeStats OutcomeProfile::stats() const {
+	outcome_counts_t outcomes;
+	for (int o = 0; o < outcome_values; o++)
+		if (outcomes_[o] > 0)
+			outcomes[(MatchOutcome) o] = outcomes_[o];
+	square_pieces_t square_pieces;
+	for (int i = 0; i < square_count; i++)
+		for (int v = 0; v < 256; v++) {
+			const Piece p((square_value_t) v);
+			if (pieces_[i * 256 + v] > 0 && !p.is_empty())
+				square_pieces[Square::from_index(i)].insert(p);
+		}
+	return OutcomeStats(size_, outcomes, square_pieces);
+}
+
 OutcomeStats OutcomeData::calculate_stats() const {
-	return OutcomeStats(*this);
+	if (stats_)
+		return *stats_;
+	return OutcomeStats(map_);
+}
+
+void OutcomeData::add_rows(const OutcomeRow *first, const OutcomeRow *last) {
+	for (auto r = first; r != last; r++)
+		map_.insert({r->board.board(), r->outcome});
+	stats_.reset();
+	rows_.reset();
+}
+
+board_outcomes_t ordered_rows(const outcome_map_t &data) {
+	// sort pointers, so that the boards are copied once
+	std::vector<const outcome_map_t::value_type *> order;
+	order.reserve(data.size());
+	for (auto &e : data)
+		order.push_back(&e);
+	std::sort(order.begin(), order.end(), [](const outcome_map_t::value_type *a, const outcome_map_t::value_type *b) {return a->first < b->first;});
+	board_outcomes_t result;
+	result.reserve(order.size());
+	for (auto e : order)
+		result.emplace_back(e->first, e->second);
+	return result;
+}
+
+std::shared_ptr<const board_outcomes_t> OutcomeData::rows() const {
+	auto result = rows_.lock();
+	if (!result) {
+		result = std::make_shared<const board_outcomes_t>(ordered_rows(map_));
+		rows_ = result;
+	}
+	return result;
 }
 
-void DataTable::init(const outcome_map_t &data,const OutcomeStats& stats) {
+Board CompactBoard::board() const {
+	Board result;
+	for (index_t i = 0; i < 8; i++)
+		for (index_t j = 0; j < 8; j++) {
+			const Piece p = at(i,j);
+			if (!p.is_empty())
+				result(i,j,p);
+		}
+	return result;
+}
+
+DataTable::DataTable(const outcome_map_t &data, const OutcomeStats &stats) :
+	rows_(std::make_shared<const board_outcomes_t>(ordered_rows(data))) {
+	init(stats);
+}
+
+DataTable::DataTable(const DataTable &table, const std::vector<uint32_t> &elements) :
+	classes_(table.classes_), rows_(table.rows_) {
+	std::vector<uint32_t> view(elements.size());
+	for (size_t i = 0; i < elements.size(); i++) {
+		ENSURE(elements[i] < (size_t) table.data_count(), "a view can only hold elements of its table");
+		view[i] = (uint32_t) table.row_of(elements[i]);
+	}
+	view_ = std::make_shared<const std::vector<uint32_t>>(std::move(view));
+}
+
+void DataTable::init(const OutcomeStats& stats) {
 	classes_ = stats.outcomes();
-	// copy data from source map into flat list
-	size_t i=0;
-	for (const auto &e : data)
-		data_[i++] = e;
-	ASSERT(i == data.size());
 }
 
 LocationEncoder::LocationEncoder(const std::vector<Square> &a, const std::vector<Piece> &v)
@@ -67,7 +235,7 @@ int LocationEncoder::value_of(const Board &b, const size_t a) const {
 }
 
 int DataTable::class_of(const size_t i) const {
-	auto oc = data_[i].second;
+	auto oc = data(i).second;
 	for (size_t i=0;i<classes_.size();i++)
 		if (classes_[i] == oc)
 			return i;
@@ -81,13 +249,20 @@ std::string SquareEncoder::attribute_name(const size_t a) const{
 }
 
 
+std::uint64_t DataTable::fingerprint() const {
+	std::uint64_t result = data_count();
+	for (size_t i = 0; i < (size_t) data_count(); i++)
+		result = (result ^ data(i).first.hash() ^ (std::uint64_t) data(i).second) * 0x100000001b3ULL;
+	return result;
+}
+
 std::string DataTable::class_name(const size_t c){
 	return to_string(classes_[c]);
 }
 
 void DataTable::collect_if(element_index_list_t &result, pred_board_outcome_t fn) const {
-		for (size_t i=0; i<data_.size(); i++)
-			if (fn(data_[i].first, data_[i].second))
+		for (size_t i=0; i<(size_t) data_count(); i++)
+			if (fn(data(i).first, data(i).second))
 				result.push_front(i);
 }
 
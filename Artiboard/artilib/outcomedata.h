@@ -1,14 +1,18 @@
+#pragma once
 #include <string>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include "id3.h"
 #include "game.h"
 namespace arti {
-  typedef std::map<Board,MatchOutcome> outcome_map_t;
+  /** Keyed on the Zobrist hash of the board; see Board::hash() */
+  typedef std::unordered_map<Board,MatchOutcome> outcome_map_t;
   typedef std::map<MatchOutcome,long> outcome_counts_t;
   typedef std::set<Piece> piece_set_t;
   typedef std::map<Square,piece_set_t> square_pieces_t;
   typedef std::pair<Board,MatchOutcome> board_outcome_t;
+  typedef std::vector<board_outcome_t> board_outcomes_t;
 
 	class OutcomeStats {
 		private:
@@ -18,6 +22,9 @@ namespace arti {
 		public:
   		// calculates the statistics from the given data
 			OutcomeStats(const outcome_map_t& data);
+			/** statistics that were calculated before */
+			OutcomeStats(const long size, const outcome_counts_t &outcomes, const square_pieces_t &square_pieces) :
+				size_(size), outcomes_(outcomes), square_pieces_(square_pieces) {}
 			long size() const {return size_;}
 			const outcome_counts_t& outcome_counts() const {return outcomes_;}
 			const square_pieces_t& square_pieces()  const {return square_pieces_;}
@@ -26,31 +33,153 @@ namespace arti {
 			std::vector<Square> squares() const;
 	};
 
-	class OutcomeData : public outcome_map_t {
+	/**
+	 * A board as one value per square, in the order of Board; a Board is built from it when needed.
+	 * It is a fraction of the size of a Board and can be written by many threads at once.
+	 */
+	class CompactBoard {
+		public:
+			CompactBoard() {_data.fill(Piece::EMPTY.index());}
+			void place(const std::size_t colIndex, const std::size_t rowIndex, const Piece &value) {_data[rowIndex * 8 + colIndex] = value.index();}
+			Piece at(const index_t colIndex, const index_t rowIndex) const {return Piece(_data[rowIndex * 8 + colIndex]);}
+			/** places the pieces file by file */
+			Board board() const;
+			bool operator< (const CompactBoard& o) const {return _data < o._data;}
+			bool operator== (const CompactBoard& o) const {return _data == o._data;}
+		private:
+			std::array<square_value_t, 64> _data;
+	};
+
+	struct OutcomeRow {
+		CompactBoard board;
+		MatchOutcome outcome;
+	};
+
+	typedef std::vector<OutcomeRow> outcome_rows_t;
+
+	/**
+	 * Counts over the rows of a data set: the pieces on every square, the outcomes, the outcomes by
+	 * ply and the outcomes by the number of every profiled piece in every profiled region.  The ply of
+	 * a board is the number of its squares with a piece other than blank.
+	 *
+	 * The counts take one pass over the rows.  Every thread counts its own range of rows into
+	 * fixed-size arrays, which are added up at the end.
+	 */
+	class OutcomeProfile {
+		public:
+			static const int outcome_values = 4; // MatchOutcome
+			static const int square_count = 64;
+			/** threads 0 is one per core */
+			OutcomeProfile(const outcome_map_t &data, const std::vector<Region> &regions = {}, const std::vector<Piece> &pieces = {},
+				const Piece &blank = Piece::EMPTY, const unsigned threads = 0);
+			OutcomeProfile(const board_outcomes_t &rows, const std::vector<Region> &regions = {}, const std::vector<Piece> &pieces = {},
+				const Piece &blank = Piece::EMPTY, const unsigned threads = 0);
+			OutcomeProfile(const OutcomeRow *first, const OutcomeRow *last, const std::vector<Region> &regions = {}, const std::vector<Piece> &pieces = {},
+				const Piece &blank = Piece::EMPTY, const unsigned threads = 0);
+			long size() const {return size_;}
+			long outcome_count(const MatchOutcome o) const {return outcomes_[o];}
+			/** the rows with p on s */
+			long piece_count(const Square &s, const Piece &p) const {return pieces_[s.index() * 256 + (unsigned char) p.index()];}
+			/** the rows of ply 0 to square_count */
+			long ply_count(const int ply) const;
+			long ply_count(const int ply, const MatchOutcome o) const {return plies_[ply * outcome_values + o];}
+			const std::vector<Region>& regions() const {return regions_;}
+			const std::vector<Piece>& pieces() const {return profiled_;}
+			/** the rows with count pieces()[p] in regions()[r] */
+			long occupancy(const std::size_t r, const std::size_t p, const int count) const;
+			long occupancy(const std::size_t r, const std::size_t p, const int count, const MatchOutcome o) const {
+				return occupancy_[((r * profiled_.size() + p) * (square_count + 1) + count) * outcome_values + o];
+			}
+			/** the outcomes and the pieces of every square */
+			OutcomeStats stats() const;
+		private:
+			template <class It> void count(It first, It last, const std::size_t n, const unsigned threads);
+			const std::vector<Region> regions_;
+			const std::vector<Piece> profiled_;
+			const Piece blank_;
+			long size_;
+			std::array<long, outcome_values> outcomes_;
+			std::vector<long> pieces_;    // [square][piece value]
+			std::vector<long> plies_;     // [ply][outcome]
+			std::vector<long> occupancy_; // [region][piece][count][outcome]
+	};
+
+	/**
+	 * the pairs of data in the order of Board::operator<.  The order of the hash map differs between
+	 * standard libraries, and the elements of a table, and so its splits, should not
+	 */
+	board_outcomes_t ordered_rows(const outcome_map_t &data);
+
+	/**
+	 * Boards with their outcomes.  The map is only changed by add_rows, which drops the statistics and
+	 * the store of rows that were kept for it, so that they never describe other pairs
+	 */
+	class OutcomeData {
 	public:
+			typedef outcome_map_t::const_iterator const_iterator;
+			const outcome_map_t& map() const {return map_;}
+			std::size_t size() const {return map_.size();}
+			bool empty() const {return map_.empty();}
+			const_iterator begin() const {return map_.begin();}
+			const_iterator end() const {return map_.end();}
+			const_iterator find(const Board &b) const {return map_.find(b);}
+			const MatchOutcome& at(const Board &b) const {return map_.at(b);}
+			std::size_t count(const Board &b) const {return map_.count(b);}
+			/** the statistics that were kept with the data if no rows were added since, or else new ones */
 			OutcomeStats calculate_stats() const;
+			/** inserts the rows in order; the first row of a board is the one that is kept */
+			void add_rows(const outcome_rows_t &rows) {add_rows(rows.data(), rows.data() + rows.size());}
+			void add_rows(const OutcomeRow *first, const OutcomeRow *last);
+			/**
+			 * the pairs of the map, in the order of ordered_rows, in one immutable store that the tables of
+			 * the data share while any of them lives.  A call without such a table copies the pairs, so it
+			 * is not safe to call on more threads at once
+			 */
+			std::shared_ptr<const board_outcomes_t> rows() const;
+	protected:
+			void keep_stats(const OutcomeStats &stats) {stats_.reset(new OutcomeStats(stats));}
+	private:
+			outcome_map_t map_;
+			std::shared_ptr<const OutcomeStats> stats_;
+			mutable std::weak_ptr<const board_outcomes_t> rows_;
 	};
 
+	/**
+	 * The elements of a table are rows of a store of board outcome pairs that tables share and no one
+	 * changes.  A table of all rows reads them in place; a view keeps the row of each of its elements,
+	 * so subsets, splits and other encodings of the same data do not copy boards.
+	 */
 	class DataTable : public ID3NameResolver {
 		public:
-			DataTable(const outcome_map_t &data, const OutcomeStats &stats) : data_(data.size()) {init(data,stats);}
+			/** copies the pairs of data into a store of this table, in the order of ordered_rows */
+			DataTable(const outcome_map_t &data, const OutcomeStats &stats);
+			/** shares the rows of data */
+			DataTable(const OutcomeData &data, const OutcomeStats &stats) : rows_(data.rows()) {init(stats);}
+			/** element i is element elements[i] of table */
+			DataTable(const DataTable &table, const std::vector<uint32_t> &elements);
 			int class_of(const size_t i) const;
-			int data_count() const {return data_.size();}
+			int data_count() const {return view_ ? view_->size() : rows_->size();}
+			/** the store of the rows of the elements, which the tables and views of one data share */
+			std::shared_ptr<const board_outcomes_t> rows() const {return rows_;}
 			virtual int value_of(const size_t i, const size_t a) const = 0;
 			virtual	int attribute_count() const = 0;
 			std::string class_name(const size_t c) final;
+			/** a hash of the boards and outcomes in the order of the table; equal for tables of the same elements */
+			std::uint64_t fingerprint() const;
 			void collect_if(element_index_list_t &result, pred_board_outcome_t fn) const;
 			void collect(element_index_list_t &result, const MatchOutcome poc) {collect_if(result,
 				[&poc](const Board& brd, const MatchOutcome &oc) {return oc == poc;});
 			}
 
 		protected:
-			const board_outcome_t& data(size_t i) const {return data_[i];}
+			const board_outcome_t& data(size_t i) const {return (*rows_)[row_of(i)];}
 		private:
-			void init(const outcome_map_t &data, const OutcomeStats &stats);
+			void init(const OutcomeStats &stats);
+			size_t row_of(const size_t i) const {return view_ ? (*view_)[i] : i;}
 		private:
 			std::vector<MatchOutcome> classes_;
-			std::vector<board_outcome_t> data_;
+			std::shared_ptr<const board_outcomes_t> rows_;
+			std::shared_ptr<const std::vector<uint32_t>> view_; // the row of every element; null if element i is row i
 	};
 
 	class DataTableEncoder {
@@ -65,6 +194,11 @@ namespace arti {
 	class DataTableWithEncoder: public DataTable {
 		public:
 			DataTableWithEncoder(DataTableEncoder &encoder, const outcome_map_t &data, const OutcomeStats &stats) : DataTable(data,stats), encoder_(encoder) {}
+			DataTableWithEncoder(DataTableEncoder &encoder, const OutcomeData &data, const OutcomeStats &stats) : DataTable(data,stats), encoder_(encoder) {}
+			/** the elements of table in another encoding */
+			DataTableWithEncoder(DataTableEncoder &encoder, const DataTable &table) : DataTable(table), encoder_(encoder) {}
+			/** element i is element elements[i] of table */
+			DataTableWithEncoder(DataTableEncoder &encoder, const DataTable &table, const std::vector<uint32_t> &elements) : DataTable(table,elements), encoder_(encoder) {}
 		  std::string attribute_name(const size_t a) final {return encoder_.attribute_name(a);}
 		  std::string value_name(const size_t a, const size_t v) {return encoder_.value_name(a,v);}
 			int attribute_count() const final {return encoder_.attribute_count();}
@@ -76,6 +210,7 @@ namespace arti {
 	class DataTableWithOwnerEncoder: public DataTableWithEncoder {
 		public:
 			DataTableWithOwnerEncoder(DataTableEncoder *encoder, const outcome_map_t &data, const OutcomeStats &stats) : DataTableWithEncoder(*encoder,data,stats), encoder_p(encoder) {}
+			DataTableWithOwnerEncoder(DataTableEncoder *encoder, const OutcomeData &data, const OutcomeStats &stats) : DataTableWithEncoder(*encoder,data,stats), encoder_p(encoder) {}
 			virtual ~DataTableWithOwnerEncoder(){delete encoder_p;}
 		protected:
 			DataTableEncoder * encoder_p;
@@ -129,12 +264,13 @@ namespace arti {
 
 	class OutcomeDataTable: public DataTableWithOwnerEncoder {
 		public:
-			/** The copy-from constructor; the data is copied into the table and can be discarded after the call */
+			/** The table shares the rows of data, which can be discarded after the call */
 			OutcomeDataTable(const OutcomeData &data) : OutcomeDataTable(data,data.calculate_stats()) {}
 			/**
-			 * Use this constructor if you have already calculated the statistics (saves a bit of time)
-			 * The data is copied into this instance
+			 * Use these constructors if you have already calculated the statistics (saves a bit of time)
+			 * The pairs of a map that is not an OutcomeData are copied into this instance
 			 */
+			OutcomeDataTable(const OutcomeData &data, const OutcomeStats &stats) : DataTableWithOwnerEncoder(new LocationEncoder(stats.squares(),stats.pieces()),data,stats) {}
 			OutcomeDataTable(const outcome_map_t &data, const OutcomeStats &stats) : DataTableWithOwnerEncoder(new LocationEncoder(stats.squares(),stats.pieces()),data,stats) {}
 	};
 
@@ -145,6 +281,8 @@ namespace arti {
 			int class_of(const size_t element) override {return table_.class_of(element);}
 			void train_and_test() {ID3Classifier::train_and_test(table_.data_count(), table_.attribute_count());}
 			void train(std::forward_list<size_t>  &elements) {ID3Classifier::train(elements,table_.attribute_count());}
+			/** see ID3Classifier::encode; the encoders are const, so the table can be encoded in parallel */
+			void encode(const unsigned threads = 0) {ID3Classifier::encode(table_.data_count(), table_.attribute_count(), threads);}
 		private:
 			const DataTable &table_;
 	};
@@ -44,11 +44,6 @@ namespace arti {
 			return Light;
 	}
 
-	ordinal_t Square::index(void) const
-	{
-		return (_rank)*8 + (_file);
-	}
-
 	ordinal_t Square::color_index(const bool flip) const
 	{
 		return flip ? (8 - _rank-1)*4 + (8 - _file - 1) / 2
@@ -65,13 +60,13 @@ namespace arti {
 	}
 
 
-	Region::Region(ordinal_t files, ordinal_t ranks) {
+	Region::Region(ordinal_t files, ordinal_t ranks) : _mask(0) {
 		for (ordinal_t r = 0; r < ranks; r++)
 			for (ordinal_t f = 0; f < files; f++)
 				insert(Square(f,r));
 	}
 
-	Region::Region(const Square &from, const int inc_f, const int inc_r, ordinal_t count) {
+	Region::Region(const Square &from, const int inc_f, const int inc_r, ordinal_t count) : _mask(0) {
 		ordinal_t f = from.file();
 		ordinal_t r = from.rank();
 		for (ordinal_t i = 0; i < count; i++)
@@ -104,34 +99,9 @@ namespace arti {
 		add(middle,-2,-2);
 	}
 
-	void Region::insert_set(const Region & s)
-	{
-		const_iterator it;
-		for (it = s.begin(); it != s.end(); it++)
-			insert(*it);
-	}
-
-
-	int Region::intersect_count(const Region & s) const
-	{
-		if (s.size() > size())
-			return s.intersect_count(*this);
-		else
-		{
-			int result = 0;
-			for (const_iterator it = s.begin(); it != s.end(); it++)
-				if (contains(*it))
-					result++;
-			return result;
-		}
-	}
-
 	void Region::intersect_rank(Region & t, const ordinal_t r) const
 	{
-		t.clear();
-		for (const_iterator it = begin(); it != end(); it++)
-			if (it->rank() == r)
-				t.insert(*it);
+		t._mask = _mask & (square_mask_t(0xFF) << (r*8));
 	}
 
 
@@ -146,31 +116,11 @@ namespace arti {
 	}
 
 
-	void Region::set_intersect(Region & t, const Region & s) const
-	{
-		if (s.size() > size())
-			s.set_intersect(t, *this);
-		else
-		{
-			t.clear();
-			for (const_iterator it = s.begin(); it != s.end(); it++)
-				if (contains(*it))
-					t.insert(*it);
-		}
-	}
-
-	void Region::set_union(Region & t, const Region & s) const
-	{
-		t = *this;
-		for (const_iterator it = s.begin(); it != s.end(); it++)
-			t.insert(*it);
-	}
-
 
 	void Region::flip()
 	{
 		Region flipped;
-		for (iterator it = begin(); it != end(); it++) {
+		for (const_iterator it = begin(); it != end(); it++) {
 			Square n(*it,true);
 			flipped.insert(n);
 		}
@@ -179,14 +129,9 @@ namespace arti {
 
 	void Region::remove_by_color(const Square::color_t color)
 	{
-		Region copy = *this;
-		clear();
-		const_iterator it;
-		for (it = copy.begin(); it != copy.end(); it++)
-		{
-			if (it->color() != color)
-				insert(*it);
-		}
+		// dark squares have an even file+rank
+		const square_mask_t dark = 0xAA55AA55AA55AA55ULL;
+		_mask &= (color == Square::Dark) ? ~dark : dark;
 	}
 
 	std::ostream & operator <<(std::ostream & o, const Region & s)
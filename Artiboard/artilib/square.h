@@ -1,9 +1,34 @@
 #pragma once
 #include <iostream>
-#include <set>
+#include <iterator>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace arti {
 	typedef unsigned short ordinal_t; 
+	/** One bit per square, bit i is the square with index() i */
+	typedef std::uint64_t square_mask_t;
+
+	inline int popcount(const square_mask_t m) {
+#ifdef _MSC_VER
+		return (int) __popcnt64(m);
+#else
+		return __builtin_popcountll(m);
+#endif
+	}
+
+	/** index of the lowest bit that is set, m cannot be zero */
+	inline ordinal_t lowest_index(const square_mask_t m) {
+#ifdef _MSC_VER
+		unsigned long r;
+		_BitScanForward64(&r, m);
+		return (ordinal_t) r;
+#else
+		return (ordinal_t) __builtin_ctzll(m);
+#endif
+	}
 	/*
 	* A square identifies a position on the gameboard
 	* A square is the ordered pair (file,rank) where the left-bottom
@@ -19,7 +44,9 @@ namespace arti {
 		static bool in_bounds(ordinal_t f, ordinal_t r)	{ return (f < 8) && (r < 8); }
 		enum color_t {Light, Dark};
 		// index for a valid square is 0 to 63
-		ordinal_t index(void) const;
+		ordinal_t index(void) const {return _rank*8 + _file;}
+		square_mask_t mask() const {return square_mask_t(1) << index();}
+		static Square from_index(const ordinal_t i) {return Square(i % 8, i / 8);}
 		ordinal_t rank() const {return _rank;} // a.k.a row
 		ordinal_t file() const {return _file;} // a.k.a.column
 		bool is_valid() const {return in_bounds(_file,_rank);}
@@ -61,12 +88,39 @@ namespace arti {
 	std::ostream & operator  <<(std::ostream &, const Square&) ;
 
 
-		// union = U
+	// union = U
 	// intersect = I
-	class Region:public std::set<Square>
+	/**
+	 * A set of squares, stored as a square_mask_t.
+	 * The members follow std::set<Square>; iteration is in index() order.
+	 */
+	class Region
 	{
 	public:
-		Region(){}
+		class const_iterator : public std::iterator<std::forward_iterator_tag,Square> {
+				square_mask_t _rest; // the squares not yet visited, including the current one
+				Square _current;
+			public:
+				explicit const_iterator(square_mask_t rest = 0) : _rest(rest) {
+					if (_rest) _current = Square::from_index(lowest_index(_rest));
+				}
+				const_iterator& operator++() {
+					_rest &= _rest - 1;
+					if (_rest) _current = Square::from_index(lowest_index(_rest));
+					return *this;
+				}
+				const_iterator operator++(int) {const_iterator tmp(*this);operator++();return tmp;}
+				bool operator==(const const_iterator& rhs) const {return _rest == rhs._rest;}
+				bool operator!=(const const_iterator& rhs) const {return _rest != rhs._rest;}
+				const Square& operator*() const {return _current;}
+				const Square* operator->() const {return &_current;}
+		};
+		typedef const_iterator iterator;
+		typedef Square value_type;
+		typedef std::size_t size_type;
+
+		Region() : _mask(0) {}
+		explicit Region(square_mask_t m) : _mask(m) {}
 		Region(ordinal_t files, ordinal_t ranks);
 		// collects squares from, from + inc , from + inc * count
 		Region(const Square &from, const int inc_f, const int inc_r, ordinal_t count);
@@ -81,23 +135,48 @@ namespace arti {
 		// this = this U (color squares of rank(r))
 		void insert_rank(const ordinal_t r, const Square::color_t color);
 
-		bool contains(const Square & s) const {return find(s) != end();}
+		/* the std::set<Square> members */
+		void insert(const Square& s) {_mask |= s.mask();}
+		size_type erase(const Square& s) {const size_type r = contains(s)?1:0; _mask &= ~s.mask(); return r;}
+		void clear() {_mask = 0;}
+		bool empty() const {return _mask == 0;}
+		size_type size() const {return popcount(_mask);}
+		size_type count(const Square& s) const {return contains(s)?1:0;}
+		const_iterator begin() const {return const_iterator(_mask);}
+		const_iterator end() const {return const_iterator();}
+		const_iterator cbegin() const {return begin();}
+		const_iterator cend() const {return end();}
+		// returns end() if s is not in this
+		const_iterator find(const Square& s) const {
+			return contains(s) ? const_iterator(_mask & ~(s.mask() - 1)) : end();
+		}
+
+		bool contains(const Square & s) const {return (_mask & s.mask()) != 0;}
+		square_mask_t mask() const {return _mask;}
+		bool operator==(const Region& o) const {return _mask == o._mask;}
+		bool operator!=(const Region& o) const {return _mask != o._mask;}
+		// this = this U s
+		Region& operator|=(const Region& s) {_mask |= s._mask; return *this;}
+		// this = this I s
+		Region& operator&=(const Region& s) {_mask &= s._mask; return *this;}
+		Region operator|(const Region& s) const {return Region(_mask | s._mask);}
+		Region operator&(const Region& s) const {return Region(_mask & s._mask);}
 	private:
 
 		/* intersect_count returns the number of elements in this that * that 
 		are also in s. */
-		int intersect_count(const Region & s) const;
+		int intersect_count(const Region & s) const {return popcount(_mask & s._mask);}
 		// this = this U s
-		void insert_set(const Region & s);
+		void insert_set(const Region & s) {_mask |= s._mask;}
 
 		// t = this I row(r): rows starts from 1
 		void intersect_rank(Region & t, const ordinal_t r) const;
 
 		// t = this I s
-		void set_intersect(Region & t, const Region & s) const;
+		void set_intersect(Region & t, const Region & s) const {t._mask = _mask & s._mask;}
 
 		// t = this U s
-		void set_union(Region & t, const Region & s) const;
+		void set_union(Region & t, const Region & s) const {t._mask = _mask | s._mask;}
 
 		/* flip Changes the state to the other players view */
 		void flip();
@@ -105,6 +184,7 @@ namespace arti {
 		// removes the squares of the given color
 		void remove_by_color(const Square::color_t color);
 
+		square_mask_t _mask;
 	};
 	std::ostream & operator  <<(std::ostream &, const Region &);
 	std::istream & operator  >>(std::istream &, Region &);
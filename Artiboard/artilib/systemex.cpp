@@ -10,6 +10,12 @@
 #else
 #include <dirent.h>
 #endif
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -41,6 +47,60 @@ namespace arti {
 	}
 
 
+#ifdef _WIN32
+	MappedFile::MappedFile(const string& file_name) : _data(0), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(0) {
+		_file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (_file == INVALID_HANDLE_VALUE)
+			throw file_not_found(file_name.c_str());
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(_file, &size)) {
+			CloseHandle(_file);
+			throw_LastError("could not find the size of " + file_name);
+		}
+		_size = (std::size_t) size.QuadPart;
+		if (_size == 0) return; // an empty file cannot be mapped
+		_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (_mapping)
+			_data = (const char *) MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!_data) {
+			if (_mapping) CloseHandle(_mapping);
+			CloseHandle(_file);
+			throw_LastError("could not map " + file_name);
+		}
+	}
+
+	MappedFile::~MappedFile() {
+		if (_data) UnmapViewOfFile(_data);
+		if (_mapping) CloseHandle(_mapping);
+		CloseHandle(_file);
+	}
+#else
+	MappedFile::MappedFile(const string& file_name) : _data(0), _size(0), _file(0), _mapping(0) {
+		const int fd = open(file_name.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw file_not_found(file_name.c_str());
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			throw runtime_error_ex("could not find the size of '%s'", file_name.c_str());
+		}
+		_size = (std::size_t) st.st_size;
+		if (_size > 0) {
+			void * p = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) {
+				close(fd);
+				throw runtime_error_ex("could not map '%s'", file_name.c_str());
+			}
+			_data = (const char *) p;
+		}
+		close(fd); // the mapping keeps the file open
+	}
+
+	MappedFile::~MappedFile() {
+		if (_data) munmap((void *) _data, _size);
+	}
+#endif
+
 	char * cstring_copy(const char *str) {
 		size_t len = strlen(str);
 		/* 1 for the null terminator */
@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <functional>
 #include <list>
+#include <chrono>
+#include <cstdint>
 #define PREVENT_COPY(X) private: X(const X &source); X & operator=(const X&);
 #define ENSURE(P,M) if (!(P)) throw arti::runtime_error_ex("%s %s %d", M, __FILE__,__LINE__)
 #define CHECK(P) if (!(P)) throw arti::runtime_error_ex("%s (%s %d)", #P, __FILE__,__LINE__)
@@ -98,6 +100,45 @@ namespace arti {
 			bool _value;
 	};
 
+	/**
+	 * Measures elapsed wall-clock time
+	 */
+	class Stopwatch {
+		public:
+			Stopwatch() : _start(clock_type::now()) {}
+			void restart() {_start = clock_type::now();}
+			double seconds() const {return std::chrono::duration<double>(clock_type::now() - _start).count();}
+		private:
+			typedef std::chrono::steady_clock clock_type;
+			clock_type::time_point _start;
+	};
+
+	/**
+	 * A file that is mapped read-only into memory; the mapping lasts as long as the instance
+	 */
+	class MappedFile {
+			PREVENT_COPY(MappedFile)
+		public:
+			explicit MappedFile(const string& file_name);
+			~MappedFile();
+			const char * data() const {return _data;}
+			std::size_t size() const {return _size;}
+			const char * begin() const {return _data;}
+			const char * end() const {return _data + _size;}
+		private:
+			const char * _data;
+			std::size_t _size;
+			void * _file;    // the handle or descriptor of the file
+			void * _mapping; // the handle of the mapping, if the system has one
+	};
+
+	/** the splitmix64 finalizer, which spreads the bits of x over the result */
+	inline std::uint64_t splitmix64(std::uint64_t x) {
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+
 	template <class T, class F> inline
 	void for_all(T coll, F fun) {std::for_each(coll.begin(), coll.end(), fun);};
 
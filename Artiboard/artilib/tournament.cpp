@@ -0,0 +1,135 @@
+#include "tournament.h"
+#include "systemex.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <exception>
+#include <cmath>
+
+namespace arti {
+
+Tournament::Tournament(const GameSpecification& spec, const unsigned workers, const unsigned seed) :
+	spec_(spec), workers_(workers == 0 ? std::max(1U, std::thread::hardware_concurrency()) : workers), seed_(seed) {
+}
+
+int Tournament::add(chooser_factory_t south, chooser_factory_t north, const int matches) {
+	pairings_.push_back({south, north, matches});
+	return (int) pairings_.size() - 1;
+}
+
+Tournament::MatchResult Tournament::play_match(const int pairing, const int match) const {
+	std::seed_seq seq{seed_, (unsigned) pairing, (unsigned) match};
+	unsigned seeds[2];
+	seq.generate(seeds, seeds + 2);
+	const Pairing& p = pairings_[pairing];
+	auto south = p.south(seeds[0]);
+	auto north = p.north(seeds[1]);
+	PickDual dual(*south, *north);
+	Match m(spec_, dual);
+	const MatchOutcome outcome = m.play();
+	return {pairing, match, outcome, (int) m.line().sequence().size() - 1};
+}
+
+void Tournament::play(aggregator_t aggregator) {
+	std::vector<std::pair<int,int>> queue;
+	int most = 0;
+	for (auto &p : pairings_)
+		most = std::max(most, p.matches);
+	for (int m = 0; m < most; m++)
+		for (int p = 0; p < (int) pairings_.size(); p++)
+			if (m < pairings_[p].matches)
+				queue.push_back(std::make_pair(p, m));
+	stopped_.reset(new std::atomic<bool>[pairings_.size()]);
+	for (std::size_t p = 0; p < pairings_.size(); p++)
+		stopped_[p] = false;
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex mutex;
+	auto work = [&]() {
+		for (std::size_t i = next++; i < queue.size() && !failed; i = next++) {
+			if (stopped_[queue[i].first])
+				continue;
+			try {
+				const MatchResult r = play_match(queue[i].first, queue[i].second);
+				std::lock_guard<std::mutex> lock(mutex);
+				aggregator(r);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!failed) error = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+	std::vector<std::thread> pool;
+	const unsigned n = std::min<std::size_t>(workers_, queue.size());
+	for (unsigned w = 1; w < n; w++)
+		pool.emplace_back(work);
+	work();
+	for (auto &t : pool)
+		t.join();
+	pairings_.clear();
+	stopped_.reset();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void MatchScore::add(const MatchOutcome outcome, const Side side) {
+	if (outcome == Draw)
+		draws_++;
+	else if ((outcome == SouthPlayerWins) == (side == Side::South))
+		wins_++;
+	else
+		losses_++;
+}
+
+float MatchScore::score() const {
+	return games() == 0 ? 0.5f : (wins_ + 0.5f * draws_) / games();
+}
+
+float MatchScore::variance() const {
+	if (games() == 0) return 0.0f;
+	const float s = score();
+	return (wins_ * (1 - s) * (1 - s) + draws_ * (0.5f - s) * (0.5f - s) + losses_ * s * s) / games();
+}
+
+float MatchScore::error(const float z) const {
+	return games() == 0 ? 1.0f : z * std::sqrt(variance() / games());
+}
+
+float MatchScore::elo_of(const float score) {
+	const float s = std::min(0.999f, std::max(0.001f, score));
+	return -400.0f * std::log10(1.0f / s - 1.0f);
+}
+
+float MatchScore::score_of(const float elo) {
+	return 1.0f / (1.0f + std::pow(10.0f, -elo / 400.0f));
+}
+
+float MatchScore::elo_error(const float z) const {
+	const float e = error(z);
+	return (elo_of(score() + e) - elo_of(score() - e)) / 2;
+}
+
+SprtRule::SprtRule(const float elo0, const float elo1, const float alpha, const float beta, const int min_games) :
+	score0_(MatchScore::score_of(elo0)), score1_(MatchScore::score_of(elo1)),
+	lower_(std::log(beta / (1 - alpha))), upper_(std::log((1 - beta) / alpha)), min_games_(min_games) {
+}
+
+float SprtRule::llr(const MatchScore& score) const {
+	// a sample without variance (say, only wins) is given a little
+	const float variance = std::max(score.variance(), 1e-3f);
+	return score.games() * (score1_ - score0_) * (2 * score.score() - score0_ - score1_) / (2 * variance);
+}
+
+int SprtRule::decision(const MatchScore& score) const {
+	if (score.games() < min_games_) return 0;
+	const float l = llr(score);
+	if (l >= upper_) return 1;
+	if (l <= lower_) return -1;
+	return 0;
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "game.h"
+#include <vector>
+#include <functional>
+#include <atomic>
+
+namespace arti {
+
+/**
+ * Plays many matches of a GameSpecification on a fixed pool of worker threads.
+ *
+ * A pairing is two chooser factories, one for the south (first) player and one for the north player,
+ * and the number of matches to play.  Every match makes its own choosers, so choosers need not be
+ * thread safe.  The seed that is given to a factory is derived from the tournament seed, the pairing
+ * and the match number only, so the outcomes do not depend on which worker plays the match.
+ *
+ * The workers take matches from a queue (round robin over the pairings, so that they progress
+ * together) and hand each result to the aggregator as soon as the match is complete.  The aggregator
+ * can stop pairings, for example when a StoppingRule is satisfied; matches that were already being played
+ * are still reported.
+ */
+class Tournament {
+	public:
+		/** Makes a chooser for one match */
+		typedef std::function<std::unique_ptr<MoveChooser>(const unsigned seed)> chooser_factory_t;
+		struct MatchResult {
+			int pairing;
+			int match;
+			MatchOutcome outcome;
+			int plies;
+		};
+		/** Receives the results, one at a time, on a worker thread */
+		typedef std::function<void(const MatchResult&)> aggregator_t;
+		/** workers = 0 uses a worker for each core */
+		explicit Tournament(const GameSpecification& spec, const unsigned workers = 0, const unsigned seed = 1);
+		/** Queue matches of south against north; returns the index of the pairing */
+		int add(chooser_factory_t south, chooser_factory_t north, const int matches);
+		/** Play all queued matches; an exception on a worker stops the tournament and is thrown here */
+		void play(aggregator_t aggregator);
+		/** Do not start more matches of pairing; call it from the aggregator */
+		void stop(const int pairing) {stopped_[pairing] = true;}
+		/** Do not start more matches */
+		void stop() {for (std::size_t p = 0; p < pairings_.size(); p++) stop((int) p);}
+		unsigned workers() const {return workers_;}
+	private:
+		struct Pairing {
+			chooser_factory_t south;
+			chooser_factory_t north;
+			int matches;
+		};
+		const GameSpecification& spec_;
+		unsigned workers_;
+		const unsigned seed_;
+		std::vector<Pairing> pairings_;
+		std::unique_ptr<std::atomic<bool>[]> stopped_;
+		MatchResult play_match(const int pairing, const int match) const;
+};
+
+/**
+ * The wins, draws and losses of one player, and the statistics of its score: 1 for a win,
+ * 0.5 for a draw and 0 for a loss.
+ */
+class MatchScore {
+	public:
+		MatchScore() : wins_(0), draws_(0), losses_(0) {}
+		/** Count outcome for the player on side */
+		void add(const MatchOutcome outcome, const Side side);
+		int wins() const {return wins_;}
+		int draws() const {return draws_;}
+		int losses() const {return losses_;}
+		int games() const {return wins_ + draws_ + losses_;}
+		/** The mean score */
+		float score() const;
+		/** The variance of the score of one game */
+		float variance() const;
+		/** Half the width of the confidence interval of score(), for the normal quantile z */
+		float error(const float z = 1.96f) const;
+		/** The Elo difference that gives score; scores are clamped to [0.001,0.999] */
+		static float elo_of(const float score);
+		/** The score of an Elo difference */
+		static float score_of(const float elo);
+		float elo() const {return elo_of(score());}
+		/** Half the width of the confidence interval of elo() */
+		float elo_error(const float z = 1.96f) const;
+	private:
+		int wins_, draws_, losses_;
+};
+
+/** Decides when enough matches have been played */
+class StoppingRule {
+	public:
+		virtual bool done(const MatchScore& score) const = 0;
+		virtual ~StoppingRule() {}
+};
+
+/**
+ * The sequential probability ratio test of H0: the Elo difference is elo0 against H1: it is elo1,
+ * with the error rates alpha (accepting H1 when H0 holds) and beta.  The log likelihood ratio uses
+ * the normal approximation of the score of a game with draws.
+ */
+class SprtRule: public StoppingRule {
+	public:
+		SprtRule(const float elo0, const float elo1, const float alpha = 0.05f, const float beta = 0.05f, const int min_games = 20);
+		float llr(const MatchScore& score) const;
+		/** 1 when H1 is accepted, -1 when H0 is accepted and 0 while undecided */
+		int decision(const MatchScore& score) const;
+		bool done(const MatchScore& score) const override {return decision(score) != 0;}
+	private:
+		const float score0_, score1_;
+		const float lower_, upper_;
+		const int min_games_;
+};
+
+/** Stops when the confidence interval of the score is at most twice half_width wide */
+class ConfidenceRule: public StoppingRule {
+	public:
+		ConfidenceRule(const float half_width, const float z = 1.96f, const int min_games = 100) :
+			half_width_(half_width), z_(z), min_games_(min_games) {}
+		bool done(const MatchScore& score) const override {
+			return score.games() >= min_games_ && score.error(z_) <= half_width_;
+		}
+	private:
+		const float half_width_, z_;
+		const int min_games_;
+};
+
+}
@@ -0,0 +1,190 @@
+#include "workers.h"
+
+namespace arti {
+
+namespace {
+	/* The pool and queue of the worker that runs on this thread */
+	thread_local const WorkerPool * this_pool = nullptr;
+	thread_local std::size_t this_queue = 0;
+}
+
+WorkerPool::WorkerPool(const unsigned workers) : queued_(0), stopping_(false) {
+	const unsigned n = workers == 0 ? std::max(1U, std::thread::hardware_concurrency()) : workers;
+	for (unsigned q = 0; q < n; q++)
+		queues_.emplace_back(new Queue());
+	for (unsigned w = 1; w < n; w++)
+		threads_.emplace_back([this, w]() {work(w);});
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	for (auto &t : threads_)
+		t.join();
+}
+
+std::size_t WorkerPool::own_queue() const {
+	return this_pool == this ? this_queue : 0;
+}
+
+void WorkerPool::push(std::function<void()> task) {
+	{
+		// counted first, so that a worker that finds it queued never takes the count below zero
+		std::lock_guard<std::mutex> lock(sleep_mutex_);
+		queued_++;
+	}
+	Queue &q = *queues_[own_queue()];
+	{
+		std::lock_guard<std::mutex> lock(q.mutex);
+		q.tasks.push_back(std::move(task));
+	}
+	wake_.notify_one();
+}
+
+bool WorkerPool::take(const std::size_t own, std::function<void()> &task) {
+	{
+		Queue &q = *queues_[own];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			queued_--;
+			return true;
+		}
+	}
+	for (std::size_t i = 1; i < queues_.size(); i++) {
+		Queue &q = *queues_[(own + i) % queues_.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			queued_--;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool WorkerPool::run_one() {
+	std::function<void()> task;
+	if (!take(own_queue(), task))
+		return false;
+	task();
+	return true;
+}
+
+void WorkerPool::work(const std::size_t index) {
+	this_pool = this;
+	this_queue = index;
+	std::function<void()> task;
+	while (true) {
+		if (take(index, task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_mutex_);
+		wake_.wait(lock, [this]() {return stopping_ || queued_ > 0;});
+		if (stopping_ && queued_ <= 0)
+			return;
+	}
+}
+
+namespace {
+	/* Shared by the caller and the workers of one loop; a worker may find it after the loop is done */
+	struct Loop {
+		Loop(const std::size_t c, std::function<void(const std::size_t)> f) : count(c), fn(f), next(0), done(0) {}
+		const std::size_t count;
+		const std::function<void(const std::size_t)> fn;
+		std::atomic<std::size_t> next;
+		std::size_t done;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable finished;
+		void run() {
+			for (std::size_t i = next++; i < count; i = next++) {
+				std::exception_ptr e;
+				try {
+					fn(i);
+				} catch (...) {
+					e = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				if (e && !error) error = e;
+				if (++done == count) finished.notify_all();
+			}
+		}
+	};
+}
+
+void WorkerPool::parallel_for(const std::size_t count, std::function<void(const std::size_t)> fn) {
+	if (count == 0) return;
+	std::shared_ptr<Loop> loop(new Loop(count, fn));
+	const std::size_t helpers = std::min(threads_.size(), count - 1);
+	for (std::size_t h = 0; h < helpers; h++)
+		push([loop]() {loop->run();});
+	loop->run();
+	std::unique_lock<std::mutex> lock(loop->mutex);
+	loop->finished.wait(lock, [&loop]() {return loop->done == loop->count;});
+	if (loop->error)
+		std::rethrow_exception(loop->error);
+}
+
+TaskGroup::~TaskGroup() {
+	help();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_++;
+	}
+	pool_.push([this, task]() {
+		std::exception_ptr e;
+		try {
+			task();
+		} catch (...) {
+			e = std::current_exception();
+		}
+		// notified under the lock, so that the group outlives it
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (e && !error_) error_ = e;
+		if (--pending_ == 0) changed_.notify_all();
+	});
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		added_++;
+	}
+	changed_.notify_all();
+}
+
+void TaskGroup::help() {
+	while (true) {
+		unsigned long added;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (pending_ == 0) return;
+			added = added_;
+		}
+		if (pool_.run_one())
+			continue;
+		// the tasks left are running elsewhere; sleep until one is done or another is queued
+		std::unique_lock<std::mutex> lock(mutex_);
+		changed_.wait(lock, [this, added]() {return pending_ == 0 || added_ != added;});
+	}
+}
+
+void TaskGroup::wait() {
+	help();
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (error_) {
+		std::exception_ptr e = error_;
+		error_ = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+}
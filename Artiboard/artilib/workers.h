@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <condition_variable>
+#include "systemex.h"
+
+namespace arti {
+
+/**
+ * A fixed set of threads that share the loops and tasks of their clients.
+ *
+ * Every worker has its own deque of tasks: it runs the newest of its own tasks first and, when it has
+ * none, steals the oldest task of another worker.  Tasks that are queued by other threads go to a shared deque.
+ * A thread that waits for tasks (see TaskGroup::wait) runs queued tasks while it waits, so tasks may
+ * queue and wait for more tasks without tying up the pool.
+ *
+ * parallel_for() offers the iterations of a loop to the workers and runs them on the calling thread too.
+ * Iterations are taken one at a time, and the caller only waits for iterations that a worker
+ * has already started, so a loop may be run from inside a task or another loop of the same pool.
+ */
+class WorkerPool {
+	PREVENT_COPY(WorkerPool)
+	public:
+		/** workers = 0 uses a thread for each core; the calling thread is one of them */
+		explicit WorkerPool(const unsigned workers = 0);
+		~WorkerPool();
+		/** The threads that run a loop, including the caller */
+		unsigned workers() const {return (unsigned) threads_.size() + 1;}
+		/** Calls fn(i) for every i in [0,count); the first exception is thrown here once the loop is done */
+		void parallel_for(const std::size_t count, std::function<void(const std::size_t)> fn);
+		/** Queues task; it must not throw */
+		void push(std::function<void()> task);
+		/** Runs one queued task on the calling thread; false if there was none */
+		bool run_one();
+	private:
+		struct Queue {
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+		std::vector<std::thread> threads_;
+		// queues_[0] is shared, queues_[w] belongs to the worker threads_[w-1]
+		std::vector<std::unique_ptr<Queue>> queues_;
+		std::atomic<long> queued_;
+		std::mutex sleep_mutex_;
+		std::condition_variable wake_;
+		bool stopping_;
+		void work(const std::size_t index);
+		std::size_t own_queue() const;
+		bool take(const std::size_t own, std::function<void()> &task);
+};
+
+/**
+ * Tasks on a WorkerPool that are waited for together; tasks may add more tasks to their group.
+ */
+class TaskGroup {
+	PREVENT_COPY(TaskGroup)
+	public:
+		explicit TaskGroup(WorkerPool &pool) : pool_(pool), pending_(0), added_(0) {}
+		/** Waits for the tasks that are still queued, but does not throw their exceptions */
+		~TaskGroup();
+		void run(std::function<void()> task);
+		/** Helps the pool until all tasks are done; the first exception of a task is thrown here */
+		void wait();
+	private:
+		WorkerPool &pool_;
+		// guarded by mutex_; changed_ is notified when a task is added and when the last one is done
+		long pending_;
+		unsigned long added_;
+		std::mutex mutex_;
+		std::condition_variable changed_;
+		std::exception_ptr error_;
+		void help();
+};
+
+}
@@ -70,4 +70,87 @@ namespace tut {
 		ensure_equals(n.size(),3);
 	END
 
+	BEGIN(9, "Region iterates in index order") 
+		Region n;
+		n.insert(Square(3,2));
+		n.insert(Square(1,0));
+		n.insert(Square(7,7));
+		n.insert(Square(1,0));
+		ensure_equals(n.size(),3);
+		auto it = n.begin();
+		ensure_equals(it->index(),1);
+		ensure_equals((++it)->index(),19);
+		ensure_equals((++it)->index(),63);
+		ensure(++it == n.end());
+		ensure(n.find(Square(3,2)) != n.end());
+		ensure(n.find(Square(3,3)) == n.end());
+		ensure_equals(n.find(Square(3,2))->index(),19);
+	END
+
+	BEGIN(10, "Region union and intersection") 
+		Region a(Square(0,0),1,0,4);
+		Region b(Square(2,0),1,0,4);
+		ensure_equals((a | b).size(),6);
+		ensure_equals((a & b).size(),2);
+		ensure((a & b).contains(Square(3,0)));
+		ensure(!(a & b).contains(Square(1,0)));
+	END
+
+	BEGIN(11, "Board counts with masks") 
+		Board board;
+		Region line(Square(0,0),1,1,8);
+		Piece x('x');
+		board(0,0,x);
+		board(1,1,x);
+		board(3,3,x);
+		board(4,4,x);
+		board(5,5,x);
+		board(5,4,x);
+		ensure_equals(board.count(line,x),5);
+		ensure_equals(board.count(line,Piece::EMPTY),3);
+		ensure_equals(board.count_repeats(line,x),3);
+		ensure_equals(board.count_repeats(line,Piece::EMPTY),2);
+		ensure_equals(board.find(line,Piece::EMPTY)->index(),18);
+		ensure(board.find(line,Piece('o')) == line.cend());
+	END
+
+	BEGIN(12, "Board counts pieces beyond the tracked ones") 
+		Board board;
+		Region row(Square(0,0),1,0,8);
+		const char * values = "abcdefgh";
+		for (ordinal_t f = 0; f < 8; f++)
+			board(f,0,Piece(values[f]));
+		board(2,1,Piece('h'));
+		board(1,0,Piece('h'));
+		board(3,0,Piece::EMPTY);
+		ensure_equals(board.count(row,Piece('a')),1);
+		ensure_equals(board.count(row,Piece('b')),0);
+		ensure_equals(board.count(row,Piece('h')),2);
+		ensure_equals(board.count(row,Piece::EMPTY),1);
+		ensure_equals(popcount(board.mask_of(Piece('h'))),3);
+		ensure_equals(popcount(board.mask_of(Piece::EMPTY)),64-8);
+		Board copy(board);
+		ensure_equals(copy.count(row,Piece('h')),2);
+	END
+
+	BEGIN(13, "Board hash follows the squares") 
+		Board a, b;
+		ensure_equals(a.hash(),0);
+		a(1,2,Piece('x'));
+		a(3,4,Piece('o'));
+		b(3,4,Piece('o'));
+		b(1,2,Piece('x'));
+		ensure_equals(a.hash(),b.hash());
+		ensure(a == b);
+		b(1,2,Piece('o'));
+		ensure(a.hash() != b.hash());
+		ensure(a != b);
+		ensure(a < b || b < a);
+		b(1,2,Piece('x'));
+		ensure(a == b);
+		b(1,2,Piece::EMPTY);
+		b(3,4,Piece::EMPTY);
+		ensure_equals(b.hash(),0);
+	END
+
 }
@@ -1,4 +1,5 @@
 #include <feat.h>
+#include <feat_code.h>
 #include <test_util.h>
 #include <log.h>
 
@@ -23,6 +24,55 @@ BEGIN(1,"Set of correct statements must parse OK")
   ensure_equals(2,program->regions().at("a2").size());
 END
 
+BEGIN(2,"Compiled formulas and functions evaluate boards")
+  FeatureProgram program;
+  program.states().add("mine", StateSet({"x"}));
+  program.states().add("taken", StateSet({"x", "o"}));
+  program.states().add("named", StateSet({"cross"}));
+  program.regions().add("row", Region(Square(0,0), 1, 0, 3));
+  program.regions().add("corner", Region(Square(0,0), 1, 0, 1));
+  program.formulas().add("full", new GroundExpression("taken", "row"));
+  program.formulas().add("start", new AndExpression(new GroundExpression("mine", "corner"), new NotExpression(new GroundExpression("taken", "row"))));
+  program.formulas().add("either", new OrExpression(new GroundExpression("named", "corner"), new GroundExpression("taken", "row")));
+  FeatureFunction * f = new FeatureFunction();
+  f->terms().emplace_back(upFeatureTerm(new FeatureTermWithFormula(2.0f, "full")));
+  f->terms().emplace_back(upFeatureTerm(new FeatureTermWithExpression(0.5f, new GroundExpression("mine", "corner"))));
+  program.functions().add("value", f);
+  const FeatureCode code(program, {{"cross", {Piece('x')}}});
+  std::vector<Board> boards(3);
+  boards[1](0, 0, Piece('x'));
+  boards[2](0, 0, Piece('x'));
+  boards[2](1, 0, Piece('o'));
+  boards[2](2, 0, Piece('x'));
+  const bool full[] = {false, false, true}, start[] = {false, true, false}, either[] = {false, true, true};
+  const float value[] = {0.0f, 0.5f, 2.5f};
+  const auto value_f = code.eval_function("value");
+  for (int i = 0; i < 3; i++) {
+    ensure_equals(code.holds(code.formula_index("full"), boards[i]), full[i]);
+    ensure_equals(code.holds(code.formula_index("start"), boards[i]), start[i]);
+    ensure_equals(code.holds(code.formula_index("either"), boards[i]), either[i]);
+    ensure_equals(code.value(code.function_index("value"), boards[i]), value[i]);
+    ensure_equals(value_f(PositionThatPoints(Ply(i), &boards[i])), value[i]);
+  }
+  std::vector<Board> batch;
+  for (int i = 0; i < 200; i++)
+    batch.push_back(boards[i % 3]);
+  std::vector<float> values(batch.size());
+  code.values(code.function_index("value"), batch.data(), batch.size(), values.data());
+  std::unique_ptr<bool[]> holds(new bool[batch.size()]);
+  code.holds(code.formula_index("start"), batch.data(), batch.size(), holds.get());
+  for (size_t i = 0; i < batch.size(); i++) {
+    ensure_equals(values[i], value[i % 3]);
+    ensure_equals(holds[i], start[i % 3]);
+  }
+  bool thrown = false;
+  try {
+    const FeatureCode unresolved(program);
+  } catch (const std::exception &) {
+    thrown = true;
+  }
+  ensure("a state without pieces", thrown);
+END
 
 }
 
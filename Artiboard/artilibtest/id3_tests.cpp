@@ -1,5 +1,10 @@
 #include <map>
+#include <random>
+#include <sstream>
+#include <atomic>
 #include <id3.h>
+#include <id3sweep.h>
+#include <id3forest.h>
 #include <test_util.h>
 #include <log.h>
 
@@ -99,5 +104,336 @@ BEGIN(1,"quinlan example classifies correctly")
 	}
 END
 
+BEGIN(2,"an encoded classifier builds the same tree")
+	QuinlanClassifier cf, encoded;
+	cf.train_and_test(cf._db._data.size(), attribute_names.size());
+	encoded.encode(encoded._db._data.size(), attribute_names.size(), 3);
+	const auto &m = *encoded.matrix();
+	ensure_equals(m.element_count(), cf._db._data.size());
+	ensure_equals(reinterpret_cast<std::uintptr_t>(m.column(1)) % 64, 0U);
+	ensure_equals(m.value_of(5, 0), (int) 'r');
+	ensure_equals(m.class_of(5), (int) 'N');
+	encoded.train_and_test(encoded._db._data.size(), attribute_names.size());
+	ensure_equals(encoded.root().size(), cf.root().size());
+	ensure_equalsf("Outlook entropy is not correct", cf.root().best_entropy, encoded.root().best_entropy);
+	FOR_EACH(k,cf._db._data)
+		ensure_equals(encoded.classify(k->first), k->second._class);
+END
+
+BEGIN(3,"the attribute matrix only holds bytes")
+	AttributeMatrix m(10, 2);
+	try {
+		m.fill([](const size_t e, const size_t a) {return e == 7 ? 256 : 1;}, [](const size_t e) {return 0;}, 2);
+		fail("a value of 256 was encoded");
+	} catch (std::runtime_error&) {
+	}
+END
+
+BEGIN(4,"scoring attributes on a pool builds the same tree")
+	QuinlanClassifier cf, pooled;
+	WorkerPool pool(3);
+	cf.encode(cf._db._data.size(), attribute_names.size(), 1);
+	cf.train_and_test(cf._db._data.size(), attribute_names.size());
+	pooled.encode(pooled._db._data.size(), attribute_names.size(), 1);
+	pooled.set_pool(&pool, 0);
+	pooled.train_and_test(pooled._db._data.size(), attribute_names.size());
+	std::stringstream expected, found;
+	expected << cf.root();
+	found << pooled.root();
+	ensure_equals(found.str(), expected.str());
+END
+
+BEGIN(5,"a pool runs every iteration once and passes on exceptions")
+	WorkerPool pool(4);
+	std::vector<int> counts(1000, 0);
+	pool.parallel_for(counts.size(), [&](const size_t i) {
+		counts[i]++;
+		// a nested loop must not wait for workers that are busy with the outer one
+		if (i % 100 == 0) pool.parallel_for(10, [](const size_t) {});
+	});
+	ensure_equals(std::count(counts.begin(), counts.end(), 1), 1000);
+	try {
+		pool.parallel_for(10, [](const size_t i) {if (i == 7) throw std::runtime_error("seven");});
+		fail("the exception was lost");
+	} catch (std::runtime_error& e) {
+		ensure_equals(std::string(e.what()), "seven");
+	}
+END
+
+BEGIN(6,"task groups run nested tasks and pass on exceptions")
+	WorkerPool pool(4);
+	std::atomic<int> count(0);
+	TaskGroup group(pool);
+	std::function<void(int)> spawn = [&](const int depth) {
+		count++;
+		if (depth < 8) {
+			group.run([&spawn,depth]() {spawn(depth + 1);});
+			group.run([&spawn,depth]() {spawn(depth + 1);});
+		}
+	};
+	spawn(0);
+	group.wait();
+	ensure_equals(count.load(), 511);
+	group.run([]() {throw std::runtime_error("task");});
+	try {
+		group.wait();
+		fail("the exception was lost");
+	} catch (std::runtime_error&) {
+	}
+END
+
+/* A larger, noisy data set in which many attributes tie */
+struct RandomClassifier : public ID3Classifier {
+	std::vector<std::vector<int>> values;
+	std::vector<int> classes;
+	explicit RandomClassifier(const size_t count, const size_t cut_off = 0) : ID3Classifier(cut_off) {
+		std::default_random_engine engine(7);
+		std::uniform_int_distribution<int> value(0, 2);
+		for (size_t e = 0; e < count; e++) {
+			std::vector<int> v;
+			for (int a = 0; a < 12; a++) v.push_back(value(engine));
+			classes.push_back((v[0] + v[3] * v[5] + (value(engine) == 0 ? 1 : 0)) % 3);
+			values.push_back(v);
+		}
+	}
+	int value_of(const size_t e, const size_t a) override {return values[e][a];}
+	int class_of(const size_t e) override {return classes[e];}
+};
+
+BEGIN(7,"building subtrees on a pool builds the same tree")
+	RandomClassifier serial(3000), pooled(3000);
+	serial.encode(3000, 12, 1);
+	serial.train(3000, 12);
+	WorkerPool pool(4);
+	pooled.encode(3000, 12);
+	pooled.set_pool(&pool, 0);
+	pooled.train(3000, 12);
+	std::stringstream expected, found;
+	expected << serial.root();
+	found << pooled.root();
+	ensure("the tree is too small to test much", serial.root().size() > 1000);
+	ensure_equals(found.str(), expected.str());
+END
+
+BEGIN(8,"the bitset engine builds the same tree")
+	RandomClassifier arrays(3000), bitsets(3000);
+	arrays.train(3000, 12);
+	bitsets.set_engine(ID3Classifier::Bitsets);
+	bitsets.train(3000, 12);
+	std::stringstream expected, found;
+	expected << arrays.root();
+	found << bitsets.root();
+	ensure_equals(found.str(), expected.str());
+	ensure_equals(bitsets.node_timing().nodes(), arrays.node_timing().nodes());
+	QuinlanClassifier quinlan;
+	quinlan.set_engine(ID3Classifier::Bitsets);
+	quinlan.train_and_test(quinlan._db._data.size(), attribute_names.size());
+	ensure_equals(quinlan.root().size(), 8);
+	ensure_equalsf("Outlook entropy is not correct",0.693536f,quinlan.root().best_entropy);
+END
+
+BEGIN(9,"the bitset engine builds the same tree on a pool")
+	RandomClassifier arrays(2000), bitsets(2000);
+	std::forward_list<size_t> subset;
+	for (size_t e = 0; e < 2000; e += 3) subset.push_front(e);
+	arrays.train(subset, 12);
+	WorkerPool pool(3);
+	bitsets.set_engine(ID3Classifier::Bitsets);
+	bitsets.set_pool(&pool, 0);
+	bitsets.encode(2000, 12);
+	bitsets.train(subset, 12);
+	std::stringstream expected, found;
+	expected << arrays.root();
+	found << bitsets.root();
+	ensure_equals(found.str(), expected.str());
+END
+
+/* The class that a walk over the nodes of the tree gives */
+int walk(ID3Classifier &fier, const ID3Node &node, const size_t e) {
+	if (!node.is_leaf())
+		for (auto &c : node.childs)
+			if (c.value == fier.value_of(e, c.attribute))
+				return walk(fier, c, e);
+	return node.dominant_class;
 }
 
+BEGIN(10,"the compiled tree classifies as the tree does")
+	RandomClassifier fier(3000);
+	std::forward_list<size_t> subset, all;
+	for (size_t e = 0; e < 3000; e++) {
+		if (e < 2000 && e % 2 == 0) subset.push_front(e);
+		all.push_front(e);
+	}
+	fier.train(subset, 12);
+	std::vector<uint32_t> elements(all.begin(), all.end());
+	std::vector<int> classes(elements.size());
+	fier.classify(elements.data(), elements.size(), classes.data());
+	int correct = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		const int expected = walk(fier, fier.root(), elements[i]);
+		ensure_equals(fier.classify(elements[i]), expected);
+		ensure_equals(classes[i], expected);
+		if (expected == fier.class_of(elements[i])) correct++;
+	}
+	std::vector<uint32_t> encoded(subset.begin(), subset.end());
+	classes.resize(encoded.size());
+	fier.classify(encoded.data(), encoded.size(), classes.data());
+	for (size_t i = 0; i < encoded.size(); i++)
+		ensure_equals(classes[i], walk(fier, fier.root(), encoded[i]));
+	fier.test(all);
+	ensure_equals(fier.root().test_count, 3000);
+	ensure_equals(fier.root().test_errors, 3000 - correct);
+	int child_count = 0;
+	for (auto &c : fier.root().childs) child_count += c.test_count;
+	ensure_equals(child_count, 3000);
+END
+
+BEGIN(11,"a sweep trains and tests as the classifiers do one at a time")
+	RandomClassifier fier(2000);
+	fier.encode(2000, 12, 1);
+	WorkerPool pool(4);
+	ID3Sweep sweep(pool);
+	sweep.add_data(fier.matrix());
+	std::vector<std::forward_list<size_t>> training(2), tests(3);
+	for (size_t e = 0; e < 2000; e++) {
+		(e % 4 == 0 ? tests[0] : training[0]).push_front(e);
+		(e % 3 == 0 ? tests[1] : training[1]).push_front(e);
+		if (e % 5 == 0) tests[2].push_front(e);
+	}
+	sweep.add_test(sweep.add_fold(training[0]), tests[0]);
+	const size_t fold = sweep.add_fold(training[1]);
+	sweep.add_test(fold, tests[1]);
+	sweep.add_test(fold, tests[2]);
+	sweep.add_cut_off(0);
+	sweep.add_cut_off(20);
+	const auto results = sweep.run();
+	ensure_equals(results.size(), 6U);
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto &r = results[i];
+		ensure_equals(r.fold, i < 2 ? 0U : 1U);
+		ensure_equals(r.cut_off, i < 2 ? i * 20 : ((i - 2) / 2) * 20);
+		RandomClassifier single(2000, r.cut_off);
+		single.use_matrix(fier.matrix());
+		std::forward_list<size_t> elements(training[r.fold]);
+		single.train(elements, 12);
+		ensure_equals(r.size, (int) single.root().size());
+		ensure_equals(r.accuracy, single.accuracy(tests[r.fold + r.test]));
+	}
+END
+
+BEGIN(12,"a forest votes the same on any pool")
+	RandomClassifier fier(3000);
+	fier.encode(3000, 12, 1);
+	std::forward_list<size_t> training, test;
+	for (size_t e = 0; e < 3000; e++)
+		(e % 3 == 0 ? test : training).push_front(e);
+	WorkerPool serial(1), pooled(4);
+	ID3Forest one(fier.matrix()), other(fier.matrix());
+	one.train(training, 16, serial, 5);
+	other.train(training, 16, pooled, 5);
+	ensure_equals(other.size(), 16U);
+	std::vector<uint32_t> elements(test.begin(), test.end());
+	std::vector<int> classes(elements.size());
+	other.classify(elements.data(), elements.size(), classes.data());
+	int correct = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		ensure_equals(one.classify(elements[i]), classes[i]);
+		ensure_equals(other.classify(elements[i]), classes[i]);
+		if (classes[i] == fier.class_of(elements[i])) correct++;
+	}
+	ensure_equalsf("accuracy", correct * 100.0f / elements.size(), other.accuracy(test));
+	bool differ = false;
+	for (size_t t = 0; t < one.size(); t++) {
+		ensure("the trees are the same", one.tree(t) == other.tree(t));
+		differ = differ || one.tree(t) != one.tree(0);
+	}
+	ensure("the trees of a forest differ", differ);
+END
+
+BEGIN(13,"updates build the tree that training on all elements builds")
+	for (size_t cut_off : {0, 20}) {
+		RandomClassifier all(3000, cut_off), updated(3000, cut_off);
+		std::forward_list<size_t> elements;
+		for (size_t e = 0; e < 3000; e++) elements.push_front(e);
+		all.train(elements, 12);
+		std::forward_list<size_t> first;
+		for (size_t e = 0; e < 500; e++) first.push_front(e);
+		updated.train(first, 12);
+		for (uint32_t e = 500; e < 3000; e += 250) {
+			std::vector<uint32_t> batch;
+			for (uint32_t b = e; b < e + 250; b++) batch.push_back(b);
+			updated.update(batch);
+		}
+		ensure("training codes the elements for itself", !updated.matrix());
+		std::stringstream expected, found;
+		expected << all.root();
+		found << updated.root();
+		ensure_equals(found.str(), expected.str());
+		ensure_equals(updated.root().class_count.size(), 3U);
+		ensure_equals(updated.root().class_count.at(0) + updated.root().class_count.at(1) + updated.root().class_count.at(2), 3000);
+		for (size_t e = 0; e < 3000; e += 7)
+			ensure_equals(updated.classify(e), all.classify(e));
+	}
+	RandomClassifier all(2000), updated(2000);
+	all.set_attribute_sample(4, 9);
+	updated.set_attribute_sample(4, 9);
+	all.train(2000, 12);
+	updated.train(1000, 12);
+	std::vector<uint32_t> batch;
+	for (uint32_t e = 1000; e < 2000; e++) batch.push_back(e);
+	updated.update(batch);
+	std::stringstream expected, found;
+	expected << all.root();
+	found << updated.root();
+	ensure_equals(found.str(), expected.str());
+END
+
+BEGIN(14,"element index sets sample without repeats and by class")
+	const ElementIndexSet all = ElementIndexSet::all(1000);
+	auto first = ElementIndexSet::engine(3, 1), second = ElementIndexSet::engine(3, 1);
+	const ElementIndexSet a = all.sample(100, first), b = all.sample(100, second);
+	ensure_equals(a.size(), 100U);
+	ensure(a.elements() == b.elements());
+	for (auto e : a)
+		ensure(all.contains(e));
+	ensure_equals(all.sample(1000, first).size(), 1000U);
+	const ElementIndexSet rest = all - a;
+	ensure_equals(rest.size(), 900U);
+	for (auto e : a)
+		ensure(!rest.contains(e));
+	ensure_equals((rest | a).size(), 1000U);
+	auto engine = ElementIndexSet::engine(5);
+	auto class_of = [](const size_t e) {return e % 10 < 7 ? 0 : e % 10 < 9 ? 1 : 2;};
+	const ElementIndexSet quarter = all.stratified_sample(1, 4, class_of, engine);
+	const auto classes = quarter.by_class(class_of);
+	ensure_equals(classes.size(), 3U);
+	ensure_equals(classes[0].size(), 175U);
+	ensure_equals(classes[1].size(), 50U);
+	ensure_equals(classes[2].size(), 25U);
+END
+
+/* the Quinlan data with values and classes that do not fit a byte */
+struct SpreadQuinlanClassifier : public QuinlanClassifier {
+	int value_of(const size_t e, const size_t a) override {return (QuinlanClassifier::value_of(e, a) - 'r') * 1000;}
+	int class_of(const size_t e) override {return QuinlanClassifier::class_of(e) == 'P' ? -300 : 300;}
+};
+
+BEGIN(15,"without a matrix values and classes can be any int, and classification calls value_of")
+	QuinlanClassifier cf;
+	SpreadQuinlanClassifier spread;
+	cf.train_and_test(cf._db._data.size(), attribute_names.size());
+	spread.train_and_test(spread._db._data.size(), attribute_names.size());
+	ensure("no matrix", !spread.matrix());
+	ensure_equals(spread.root().size(), cf.root().size());
+	ensure_equalsf("Outlook entropy is not correct", cf.root().best_entropy, spread.root().best_entropy);
+	ensure_equalsf("root must be certain", 100.0f, spread.root().certainty());
+	for (auto &c : spread.root().childs)
+		ensure(c.value == -3000 || c.value == 0 || c.value == 1000);
+	FOR_EACH(k,cf._db._data)
+		ensure_equals(spread.classify(k->first), k->second._class == 'P' ? -300 : 300);
+	// element 0 gets the values of element 2, which has the other class
+	spread._db._data[0] = spread._db._data[2];
+	ensure_equals(spread.classify(0), -300);
+END
+
+}
@@ -0,0 +1,74 @@
+#include <tut/tut.hpp>
+#include <board.h>
+#include <game.h>
+#include <negamax.h>
+#include <exception>
+#include <iterator>
+#include <test_util.h>
+#define TESTDATA SearchData
+namespace tut {
+	using namespace arti;
+
+	struct SearchData {};
+	test_group<SearchData> searchTests("020 Search Tests");
+
+	/** a piece that slides one file to the right, or passes */
+	class SlideSpecification : public GameSpecification {
+		public:
+			void collectMoves(const Position& pos, Move::SharedFWList &result) const override {
+				for (index_t f = 0; f < 7; f++)
+					if (pos.board()(f,0) == Piece('a')) {
+						shared_ptr<Step> from(new StepToPlace(Square(f,0), Piece::EMPTY));
+						shared_ptr<Step> to(new StepToPlace(Square(f+1,0), Piece('a')));
+						result.emplace_front(new Move(from));
+						result.front()->add(to);
+						shared_ptr<Step> pass(new StepToPlace(Square(f,0), Piece('a')));
+						result.emplace_front(new Move(pass));
+					}
+			}
+			MatchOutcome outcome_of(const Position& pos) const override {return Unknown;}
+		protected:
+			void setup(Board& board) const override {board(0,0,Piece('a'));}
+	};
+
+	BEGIN(1, "Compact moves of the default collect_moves change several squares or none")
+		SlideSpecification spec;
+		const PositionThatOwns pos(Ply::ZERO, spec.initialBoard());
+		Board::u_ptr_list boards;
+		spec.collectBoards(pos, boards);
+		CompactMove moves[GameSpecification::max_moves];
+		ensure_equals(spec.collect_moves(pos, moves), 2);
+		Board b(pos.board());
+		int i = 0;
+		for (auto &child : boards) {
+			spec.make_move(b, moves[i]);
+			ensure("made move differs", b == *child);
+			spec.unmake_move(b, moves[i]);
+			ensure("unmake differs", b == pos.board());
+			i++;
+		}
+		ensure_equals((int) moves[0].count + moves[1].count, 2);
+	END
+
+	BEGIN(2, "A transposition table keeps the index of the best move and selects the same move")
+		SlideSpecification spec;
+		const PositionThatOwns pos(Ply::ZERO, spec.initialBoard());
+		const eval_function_t f = [](const Position& p) {return (float) lowest_index(p.board().mask_of(Piece('a')));};
+		PickNegamaxAlphaBeta plain(&spec, f, 4), tabled(&spec, f, 4);
+		TranspositionTable table(1);
+		tabled.set_table(&table);
+		Board::u_ptr_list plainChildren, tabledChildren;
+		spec.collectBoards(pos, plainChildren);
+		spec.collectBoards(pos, tabledChildren);
+		const auto plainPick = plain.select(pos, plainChildren);
+		const auto tabledPick = tabled.select(pos, tabledChildren);
+		ensure("a move is selected", tabledPick != tabledChildren.end());
+		ensure_equals(std::distance(tabledChildren.begin(), tabledPick), std::distance(plainChildren.begin(), plainPick));
+		TranspositionTable::Entry entry;
+		for (auto &child : tabledChildren) {
+			ensure("child searched", table.probe(TranspositionTable::key_of(*child, Ply::ZERO.next()), entry) == TranspositionTable::Hit);
+			ensure("index within the moves", entry.best < 2);
+		}
+	END
+
+}
@@ -122,6 +122,23 @@ void Connect4::collectMoves(const Position& pos, Move::SharedFWList &result) con
 	}
 }
 
+/** The moves of collectMoves, files in ascending order */
+int Connect4::collect_moves(const Position& pos, CompactMove * moves) const {
+	if (outcome_of(pos) != Unknown)
+		return 0;
+	auto piece = piece_for(pos.ply().side_to_move());
+	int n = 0;
+	for (auto i = 0U; i < files.size(); i++) {
+		const Region& r = *files[i];
+		auto it = pos.board().find(r,open);
+		if (it != r.cend()) {
+			moves[n].set((*it).index(), piece);
+			n++;
+		}
+	}
+	return n;
+}
+
 arti::Piece annotate(const Board::const_iterator& it) {
 	if (*it == Piece::EMPTY) return *it;
 	else { 
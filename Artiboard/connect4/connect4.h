@@ -16,6 +16,7 @@ public:
 	void setup(arti::Board&) const override;
 	MatchOutcome outcome_of(const Position&) const override;
 	void collectMoves(const Position& pos, Move::SharedFWList &result) const override;
+	int collect_moves(const Position& pos, CompactMove * moves) const override;
 	static const Piece north;
 	static const Piece south;
 	static const Piece open;
@@ -1,6 +1,8 @@
 #include <experiment.h>
 #include <feat.h>
 #include <id3.h>
+#include <id3sweep.h>
+#include <id3forest.h>
 #include <forward_list>
 #include <log.h>
 #include "connect4.h"
@@ -38,20 +40,13 @@ class FairnessExperiment: public Experiment {
 
 
 
+/** the outcomes for North of the rows that count gives for every outcome */
 struct DataStat {
-	DataStat() : wins(0), losses(0), draws(0) {};
-	void inc(const MatchOutcome& e) {
-			if (e == NorthPlayerWins)
-				wins++;
-			else if (e == SouthPlayerWins)
-				losses++;
-			else
-				draws++;		
-	}
-
-	int wins;
-	int losses;
-	int draws;
+	DataStat(std::function<long (const MatchOutcome)> count) :
+		wins(count(NorthPlayerWins)), losses(count(SouthPlayerWins)), draws(count(Draw) + count(Unknown)) {}
+	long wins;
+	long losses;
+	long draws;
 };
 
 std::ostream& operator << (std::ostream& os, const DataStat& s) {
@@ -65,22 +60,66 @@ public:
 	void do_run() override {
 		file() << "ply wins losses draws";
 		const IcuData data(args()["icu_file"]);
-		std::map<int,DataStat> stats;
-		FOR_EACH(p,data) {
-			int ply = ply_of(p->first);
-			stats[ply].inc(p->second);
-		}
-		FOR_EACH(s,stats)
-			file() << s->first << s->second;
+		// the ply of a board is its pieces other than the open squares; see ply_of
+		const OutcomeProfile profile(data.map(), {}, {}, Connect4::open);
+		for (int ply = 0; ply <= OutcomeProfile::square_count; ply++)
+			if (profile.ply_count(ply) > 0)
+				file() << ply << DataStat([&](const MatchOutcome o) {return profile.ply_count(ply, o);});
 		file() << data.size();
 	}
 } c4_020;
 
+class BoardLookupTiming: public Experiment {
+public:
+	BoardLookupTiming(): Experiment("c4-022","How fast can ICU data positions be looked up?") {}
+	void do_run() override {
+		file() << "container operation seconds";
+		Stopwatch watch;
+		const IcuData data(args()["icu_file"]);
+		file() << "hash load " << watch.seconds();
+		std::vector<Board> keys;
+		keys.reserve(data.size());
+		for (auto &e : data) keys.push_back(e.first);
+		watch.restart();
+		std::map<Board,MatchOutcome> ordered(data.begin(),data.end());
+		file() << "ordered insert " << watch.seconds();
+		const int rounds = 10;
+		long found = 0;
+		watch.restart();
+		for (int i = 0; i < rounds; i++)
+			for (auto &k : keys) found += ordered.count(k);
+		file() << "ordered find " << watch.seconds();
+		watch.restart();
+		for (int i = 0; i < rounds; i++)
+			for (auto &k : keys) found += data.count(k);
+		file() << "hash find " << watch.seconds();
+		CHECK(found == (long) (2 * rounds * keys.size()));
+	}
+} c4_022;
+
 class C4IcuExperiment : public Experiment {
 	public:
 		C4IcuExperiment(const char * name, const string &desc) : Experiment(name,desc) {}
 	protected:
 		std::string data_filename() {return args()["icu_file"];}
+		/** icu_cache names the image of the data file, which is next to it by default; icu_cache=none reads the data file */
+		std::string cache_filename() {
+			if (!args().contains("icu_cache")) return data_filename() + ".cache";
+			const std::string &c = args()["icu_cache"];
+			return c == "none" ? "" : c;
+		}
+		/** encodes the table, or copies the encoding of the table that the image of data keeps */
+		void encode(const IcuData &data, const OutcomeDataTable &table, OutcomeDataClassifier &fier) {
+			const auto cache = data.cache();
+			const auto fingerprint = table.fingerprint();
+			const auto matrix = cache ? cache->matrix("location", fingerprint) : nullptr;
+			if (matrix)
+				fier.use_matrix(matrix);
+			else {
+				fier.encode();
+				if (cache) cache->store("location", fingerprint, *fier.matrix());
+			}
+		}
 };
 
 /**
@@ -112,108 +151,114 @@ class C4IcuExperiment : public Experiment {
  */
 class ExampleStratExperiment : public C4IcuExperiment {
 public:
-		typedef std::function<void (std::forward_list<size_t> &result)> selector_fn;
+		typedef ElementIndexSet::engine_t engine_t;
+		typedef std::function<ElementIndexSet (engine_t &engine)> selector_fn;
 
 		ExampleStratExperiment() : C4IcuExperiment("c4-025","The effect of the test selection strategy on ID3 accuracy") {}
 		void do_run() override {
-			IcuData data(data_filename());
+			IcuData data(data_filename(), cache_filename());
 			OutcomeDataTable table(data);
 			// calculate the sets
-			ElementIndexList D,Dn,Ds,Dd;
-			D.fill(data.size());
-			table.collect(Dn,MatchOutcome::NorthPlayerWins);
-			table.collect(Ds,MatchOutcome::SouthPlayerWins);
-			table.collect(Dd,MatchOutcome::Draw);
-			Dn.collect_random_subset(Un,(Dn.size()*1)/4);
-			Ds.collect_random_subset(Us,(Ds.size()*1)/4);
-			Dd.collect_random_subset(Ud,(Dd.size()*1)/4);
-			U.prepend(Un);
-			U.prepend(Us);
-			U.prepend(Ud);
+			ElementIndexList Ln,Ls,Ld;
+			table.collect(Ln,MatchOutcome::NorthPlayerWins);
+			table.collect(Ls,MatchOutcome::SouthPlayerWins);
+			table.collect(Ld,MatchOutcome::Draw);
+			const ElementIndexSet D = ElementIndexSet::all(data.size()), Dn(Ln), Ds(Ls), Dd(Ld);
+			auto engine = ElementIndexSet::engine(1);
+			Un = Dn.sample(Dn.size()/4,engine);
+			Us = Ds.sample(Ds.size()/4,engine);
+			Ud = Dd.sample(Dd.size()/4,engine);
+			U = Un | Us | Ud;
+			T = D - U;
 			LOG << "|U|=" << U.size() << " |T|=" << T.size() << " |D|=" << D.size();
 			CHECK(Ud.size() + Us.size() + Un.size() == U.size());
-			for (auto e : D) {
-				if (!U.contains(e)) T.push_front(e);
-			}
-			LOG << "|U|=" << U.size() << " |T|=" << T.size() << " |D|=" << D.size();
 			CHECK(U.size() + T.size() == D.size());
-			// build the decision tree
+			// build one decision tree and test it on U, T and the samples of every strategy
 			OutcomeDataClassifier fier(table,0);
-			fier.train(T);
-			LOG << "U accuracy = " << fier.accuracy(U);
-			CHECK(fier.accuracy(T) == 100);
-			file() << "Strategy Measurement Size";
-			run_strategy(fier,"W",Us);
-			run_strategy(fier,"L",Un);
-			//run_strategy(fier,"D",Ud);
-			run_strategy(fier,"M",U);
-			run_strategy(fier,"B",
-				[&](std::forward_list<size_t> &result) {
+			encode(data, table, fier);
+			WorkerPool pool;
+			ID3Sweep sweep(pool);
+			sweep.add_data(fier.matrix());
+			sweep.add_cut_off(0);
+			const size_t fold = sweep.add_fold(T.list());
+			add_test(sweep,fold,"U",U);
+			add_test(sweep,fold,"T",T);
+			Stopwatch watch;
+			run_strategy(pool,sweep,fold,"W",Us);
+			run_strategy(pool,sweep,fold,"L",Un);
+			//run_strategy(pool,sweep,fold,"D",Ud);
+			run_strategy(pool,sweep,fold,"M",U);
+			run_strategy(pool,sweep,fold,"B",
+				[&](engine_t &engine) {
 					auto fs = (Us.size() * 1000) / U.size();
 					auto fn = (Un.size() * 1000) / U.size();
 					auto fd = 1000 - fs - fn;
-					Us.collect_random_subset(result,fs);
-					Un.collect_random_subset(result,fn);
-					Ud.collect_random_subset(result,fd);
+					return Us.sample(fs,engine) | Un.sample(fn,engine) | Ud.sample(fd,engine);
 				});
+			LOG << "sampling took " << watch.seconds() << "s";
+			const auto results = sweep.run();
+			LOG << "U accuracy = " << results[0].accuracy;
+			CHECK(results[1].accuracy == 100);
+			file() << "Strategy Measurement Size";
+			for (size_t i = 2; i < results.size(); i++)
+				file() << names_[i] << " " << results[i].accuracy << " " << sizes_[i];
 			//fier.root().to_stream(LOG, table);
 //			LOG << data.calculate_stats();
 			// TODO 200 implement example selection strategy experiment
 		}
 
-		void run_strategy(OutcomeDataClassifier& f, const char * name, const ElementIndexList& s) {
-			run_strategy(f,name,[&s](std::forward_list<size_t> &result){s.collect_random_subset(result,1000);});
+		void add_test(ID3Sweep& sweep, const size_t fold, const std::string &name, const ElementIndexSet &ts) {
+			sweep.add_test(fold,ts.list());
+			names_.push_back(name);
+			sizes_.push_back(ts.size());
 		}
 
-		void run_strategy(OutcomeDataClassifier& f, const char * name, selector_fn fn) {
-			for (int i=0;i<100;i++) {
-				std::forward_list<size_t> ts;
-				fn(ts);
-				file() << name << " " << f.accuracy(ts) << " " << size_of(ts);
-			}
+		void run_strategy(WorkerPool &pool, ID3Sweep& sweep, const size_t fold, const char * name, const ElementIndexSet& s) {
+			run_strategy(pool,sweep,fold,name,[&s](engine_t &engine){return s.sample(1000,engine);});
+		}
+
+		/** draws the 100 samples of a strategy in parallel; sample i draws from stream i of the strategy */
+		void run_strategy(WorkerPool &pool, ID3Sweep& sweep, const size_t fold, const char * name, selector_fn fn) {
+			const unsigned strategy = (unsigned) names_.size();
+			std::vector<ElementIndexSet> samples(100);
+			pool.parallel_for(samples.size(), [&](const size_t i) {
+				auto engine = ElementIndexSet::engine(strategy, (unsigned) i);
+				samples[i] = fn(engine);
+			});
+			for (auto &ts : samples)
+				add_test(sweep,fold,name,ts);
 		}
 
 private:
-		ElementIndexList U,T, Un, Us, Ud;
+		ElementIndexSet U,T, Un, Us, Ud;
+		std::vector<std::string> names_; // of the test sets
+		std::vector<size_t> sizes_;
 } c4_025;
 
 class MOCutOff: public C4IcuExperiment {
-private:
-		ElementIndexList D,U,T,Dn,Ds,Dd;
 public:
 		MOCutOff(): C4IcuExperiment("c4-026","Influence of the MO cut-off on ID3 - balanced") {}
-	void balance_selectUT() {
-		ElementIndexList Un, Us, Ud;
-		U.clear();
-		T.clear();
-		Dn.collect_random_subset(Un,(Dn.size()*1)/4);
-		Ds.collect_random_subset(Us,(Ds.size()*1)/4);
-		Dd.collect_random_subset(Ud,(Dd.size()*1)/4);
-		U.prepend(Un);
-		U.prepend(Us);
-		U.prepend(Ud);
-		for (auto e : D) {
-			if (!U.contains(e)) T.push_front(e);
-		}
-	}
 	void do_run() override {
-		IcuData data(data_filename());
+		IcuData data(data_filename(), cache_filename());
 		OutcomeDataTable table(data);
-		D.fill(data.size());
-		table.collect(Dn,MatchOutcome::NorthPlayerWins);
-		table.collect(Ds,MatchOutcome::SouthPlayerWins);
-		table.collect(Dd,MatchOutcome::Draw);
+		OutcomeDataClassifier fier(table);
+		encode(data, table, fier);
+		const auto matrix = fier.matrix();
+		const ElementIndexSet D = ElementIndexSet::all(data.size());
+		WorkerPool pool;
+		ID3Sweep sweep(pool);
+		sweep.add_data(matrix);
+		for (int i = 0; i < 10; i++)
+			sweep.add_cut_off((i+1) * 32);
+		// each fold tests on a quarter of every outcome and trains on the rest
+		for (unsigned o = 0; o < 30; o++) {
+			auto engine = ElementIndexSet::engine(1, o);
+			const ElementIndexSet U = D.stratified_sample(1, 4, [&](const size_t e) {return matrix->class_of(e);}, engine);
+			sweep.add_test(sweep.add_fold((D - U).list()), U.list());
+		}
 		file() << "Cutoff Accuracy Size";
-		for (int o = 0; o < 30; o++)
-				for (int i = 0; i < 10; i++) {
-					const int cutoff = (i+1) * 32;
-					std::cout << " " << o  << ":" << i;
-					OutcomeDataClassifier fier(table,cutoff);
-					balance_selectUT();
-					fier.train(T);
-					fier.test(U);
-					file() << cutoff << " " << fier.root().certainty() << " " << fier.root().size();
-				}
+		for (auto &r : sweep.run())
+			file() << r.cut_off << " " << r.accuracy << " " << r.size;
 	}
 } c4_026;
 
@@ -222,20 +267,20 @@ public:
 		MOCutOffT(): C4IcuExperiment("c4-027","Influence of the MO cut-off on ID3 - trained") {}
 	void do_run() override {
 		ElementIndexList training_set;
-		IcuData data(data_filename());
+		IcuData data(data_filename(), cache_filename());
 		OutcomeDataTable table(data);
 		training_set.fill(data.size());
+		OutcomeDataClassifier fier(table);
+		encode(data, table, fier);
+		WorkerPool pool;
+		ID3Sweep sweep(pool);
+		sweep.add_data(fier.matrix());
+		sweep.add_fold(training_set);
+		for (int i = 0; i < 30; i++)
+			sweep.add_cut_off(i * 8);
 		file() << "Cutoff Accuracy Size";
-		const int steps = 30;
-		set_steps(steps);
-		for (int i = 0; i < steps; i++) {
-			const int cutoff = i * 8;
-			OutcomeDataClassifier fier(table,cutoff);
-			fier.train(training_set);
-			fier.test(training_set);
-			file() << cutoff << " " << fier.root().certainty() << " " << fier.root().size();
-			step();
-		}
+		for (auto &r : sweep.run())
+			file() << r.cut_off << " " << r.accuracy << " " << r.size;
 	}
 } c4_027;
 
@@ -244,7 +289,7 @@ public:
 		EncodingExp(): C4IcuExperiment("c4-028","Influence of the encoding") {}
 	void do_run() override {
 		ElementIndexList training_set;
-		IcuData data(data_filename());
+		IcuData data(data_filename(), cache_filename());
 		training_set.fill(data.size());
 		std::cout << "calculating stats\n";
 		const auto stats = data.calculate_stats();
@@ -258,27 +303,231 @@ public:
 			{"SRE", new LocationRegionEncoder(stats.squares(),stats.pieces())},
 			{"ERE", new EnhancedLocationRegionEncoder(stats.squares(),stats.pieces())}
 		};
+		WorkerPool pool;
+		ID3Sweep sweep(pool);
+		for (auto &e : encoders) {
+			DataTableWithEncoder table(*e.second,data,stats);
+			OutcomeDataClassifier fier(table);
+			fier.encode();
+			sweep.add_data(fier.matrix());
+		}
+		sweep.add_fold(training_set);
+		for (int i = 0; i < 12; i++)
+			sweep.add_cut_off(i * 16);
 		file() << "Cutoff Encoding Accuracy Size";
-		const int increments = 12;
-		const int steps = increments*encoders.size();
-		set_steps(steps);
-		for (int i = 0; i < increments; i++) {
-			const int cutoff = i * 16;
-			for (auto &e : encoders) {
-				DataTableWithEncoder table(*e.second,data,stats);
-				OutcomeDataClassifier fier(table,cutoff);
+		for (auto &r : sweep.run())
+			file() << r.cut_off << " " << encoders[r.data].first << " " << r.accuracy << " " << r.size;
+
+		for (auto &e : encoders)
+			delete e.second;
+	}
+} c4_028;
+
+/**
+ * Trains both ID3 engines on all ICU positions and writes how long they take to split a node,
+ * by the size of the node.  The value encoders have three values per square, the region
+ * encoders only Y and N.
+ */
+class EngineTiming: public C4IcuExperiment {
+public:
+		EngineTiming(): C4IcuExperiment("c4-029","How fast do the ID3 engines split nodes?") {}
+	void do_run() override {
+		IcuData data(data_filename(), cache_filename());
+		const auto stats = data.calculate_stats();
+		ElementIndexList training_set;
+		training_set.fill(data.size());
+		typedef std::pair<std::string,DataTableEncoder*> encoder_t;
+		std::vector<encoder_t> encoders{
+			{"SLE", new LocationEncoder(stats.squares(),stats.pieces())},
+			{"SRE", new LocationRegionEncoder(stats.squares(),stats.pieces())},
+			{"ERE", new EnhancedLocationRegionEncoder(stats.squares(),stats.pieces())}
+		};
+		const std::vector<std::pair<std::string,ID3Classifier::Engine>> engines{
+			{"arrays", ID3Classifier::Arrays}, {"bitsets", ID3Classifier::Bitsets}};
+		file() << "Encoding Engine Elements Nodes Seconds MicrosecondsPerNode";
+		for (auto &e : encoders) {
+			DataTableWithEncoder table(*e.second,data,stats);
+			std::shared_ptr<const AttributeMatrix> matrix;
+			std::string tree;
+			for (auto &engine : engines) {
+				OutcomeDataClassifier fier(table,0);
+				if (!matrix) fier.encode(); else fier.use_matrix(matrix);
+				matrix = fier.matrix();
+				fier.set_engine(engine.second);
 				fier.train(training_set);
-				fier.test(training_set);
-				LOG << cutoff << " " << e.first;
-				file() << cutoff << " " << e.first << " " << fier.root().certainty() << " " << fier.root().size();
-				step();
+				const auto &t = fier.node_timing();
+				for (size_t b = 0; b < t.buckets(); b++)
+					if (t.nodes(b) > 0)
+						file() << e.first << " " << engine.first << " " << (1 << b) << " " << t.nodes(b) << " "
+							<< t.seconds(b) << " " << t.seconds(b) * 1e6 / t.nodes(b);
+				file() << e.first << " " << engine.first << " all " << t.nodes() << " " << t.seconds() << " " << t.seconds() * 1e6 / t.nodes();
+				std::stringstream ss;
+				ss << fier.root();
+				if (tree.empty()) tree = ss.str();
+				CHECK(tree == ss.str());
 			}
 		}
+		for (auto &e : encoders)
+			delete e.second;
+	}
+} c4_029;
+
+/* The class of element, from a walk over the nodes of the tree */
+static int walk(const AttributeMatrix &m, const ID3Node &node, const size_t element) {
+	if (!node.is_leaf())
+		for (auto &c : node.childs)
+			if (c.value == m.value_of(element, c.attribute))
+				return walk(m, c, element);
+	return node.dominant_class;
+}
 
+class ClassifyTiming: public C4IcuExperiment {
+public:
+		ClassifyTiming(): C4IcuExperiment("c4-031","How fast does a trained ID3 tree classify?") {}
+	void do_run() override {
+		IcuData data(data_filename(), cache_filename());
+		const auto stats = data.calculate_stats();
+		ElementIndexList training_set;
+		training_set.fill(data.size());
+		std::vector<uint32_t> elements(training_set.begin(), training_set.end());
+		std::vector<int> expected(elements.size()), found(elements.size());
+		const int repeats = 10;
+		typedef std::pair<std::string,DataTableEncoder*> encoder_t;
+		std::vector<encoder_t> encoders{
+			{"SLE", new LocationEncoder(stats.squares(),stats.pieces())},
+			{"ERE", new EnhancedLocationRegionEncoder(stats.squares(),stats.pieces())}
+		};
+		file() << "Encoding Nodes Bytes Method Elements NanosecondsPerElement";
+		for (auto &e : encoders) {
+			DataTableWithEncoder table(*e.second,data,stats);
+			OutcomeDataClassifier fier(table,0);
+			fier.encode();
+			fier.train(training_set);
+			const AttributeMatrix &m = *fier.matrix();
+			const CompiledTree &tree = fier.compiled();
+			const std::string prefix = e.first + " " + std::to_string(fier.root().size()) + " " + std::to_string(tree.memory()) + " ";
+			auto report = [&](const std::string &method, const size_t count, const double seconds) {
+				file() << prefix << method << " " << count << " " << seconds * 1e9 / count;
+			};
+			Stopwatch watch;
+			for (int r = 0; r < repeats; r++)
+				for (size_t i = 0; i < elements.size(); i++)
+					expected[i] = walk(m, fier.root(), elements[i]);
+			report("nodes", repeats * elements.size(), watch.seconds());
+			watch.restart();
+			for (int r = 0; r < repeats; r++)
+				for (size_t i = 0; i < elements.size(); i++)
+					found[i] = tree.classify(m, elements[i]);
+			report("compiled", repeats * elements.size(), watch.seconds());
+			CHECK(found == expected);
+			watch.restart();
+			for (int r = 0; r < repeats; r++)
+				fier.classify(elements.data(), elements.size(), found.data());
+			report("batch", repeats * elements.size(), watch.seconds());
+			CHECK(found == expected);
+			// as a search would, from the boards themselves
+			int sum = 0;
+			watch.restart();
+			for (int r = 0; r < repeats; r++)
+				for (auto &b : data)
+					sum += tree.classify([&e, &b](const size_t a) {return e.second->value_of(b.first, a);});
+			report("boards", repeats * data.size(), watch.seconds());
+			CHECK(sum > 0);
+		}
 		for (auto &e : encoders)
 			delete e.second;
 	}
-} c4_028;
+} c4_031;
+
+/**
+ * Trains forests of trees on two thirds of the ICU positions and tests them on the others, next to a
+ * single tree.  The nanoseconds are those of batch classification of the test set.
+ */
+class ForestExperiment: public C4IcuExperiment {
+public:
+		ForestExperiment(): C4IcuExperiment("c4-032","How much accuracy do ID3 forests buy and what do they cost?") {}
+	void do_run() override {
+		IcuData data(data_filename(), cache_filename());
+		OutcomeDataTable table(data);
+		OutcomeDataClassifier fier(table);
+		encode(data, table, fier);
+		std::forward_list<size_t> training, test;
+		for (size_t e = 0; e < data.size(); e++)
+			(e % 3 == 0 ? test : training).push_front(e);
+		const std::vector<uint32_t> elements(test.begin(), test.end());
+		std::vector<int> classes(elements.size());
+		WorkerPool pool;
+		file() << "Method Trees Attributes TrainSeconds TreesPerSecond BytesPerTree Accuracy NanosecondsPerElement";
+		{
+			MatrixClassifier tree(fier.matrix());
+			Stopwatch watch;
+			tree.set_pool(&pool);
+			tree.train(training, table.attribute_count());
+			const double seconds = watch.seconds();
+			watch.restart();
+			tree.classify(elements.data(), elements.size(), classes.data());
+			const double classify = watch.seconds();
+			file() << "tree 1 " << table.attribute_count() << " " << seconds << " " << 1 / seconds << " "
+				<< tree.compiled().memory() << " " << tree.accuracy(test) << " " << classify * 1e9 / elements.size();
+		}
+		for (size_t attributes : {0, 14, 42})
+			for (size_t trees : {4, 16, 64}) {
+				ID3Forest forest(fier.matrix());
+				forest.set_attribute_sample(attributes);
+				Stopwatch watch;
+				forest.train(training, trees, pool);
+				const double seconds = watch.seconds();
+				watch.restart();
+				forest.classify(elements.data(), elements.size(), classes.data());
+				const double classify = watch.seconds();
+				file() << "forest " << trees << " " << (attributes == 0 ? "sqrt" : std::to_string(attributes)) << " " << seconds << " "
+					<< trees / seconds << " " << forest.memory() / trees << " " << forest.accuracy(test) << " " << classify * 1e9 / elements.size();
+			}
+	}
+} c4_032;
+
+/**
+ * Trains a tree on part of the ICU positions and feeds it the others in batches, as positions from
+ * running matches would arrive.  Every update is timed next to training a tree on all positions so far;
+ * SplitNodes are the nodes that the update had to train again.
+ */
+class UpdateTiming: public C4IcuExperiment {
+public:
+		UpdateTiming(): C4IcuExperiment("c4-033","How fast do ID3 updates absorb new positions?") {}
+	void do_run() override {
+		IcuData data(data_filename(), cache_filename());
+		OutcomeDataTable table(data);
+		OutcomeDataClassifier encoded(table);
+		encode(data, table, encoded);
+		const size_t first = data.size() / 2;
+		file() << "Cutoff Batch Elements UpdateSeconds RetrainSeconds Size SplitNodes";
+		for (size_t cutoff : {0, 32})
+			for (size_t batch : {50, 2000}) {
+				OutcomeDataClassifier fier(table, cutoff);
+				std::forward_list<size_t> elements;
+				for (size_t e = 0; e < first; e++)
+					elements.push_front(e);
+				fier.train(elements);
+				const size_t last = std::min<size_t>(data.size(), first + (batch < 1000 ? 20 : 10) * batch);
+				for (size_t e = first; e < last; e += batch) {
+					std::vector<uint32_t> added;
+					for (size_t b = e; b < std::min(last, e + batch); b++)
+						added.push_back((uint32_t) b);
+					Stopwatch watch;
+					fier.update(added);
+					const double update = watch.seconds();
+					for (auto b : added)
+						elements.push_front(b);
+					MatrixClassifier retrained(encoded.matrix(), cutoff);
+					watch.restart();
+					retrained.train(elements, table.attribute_count());
+					file() << cutoff << " " << batch << " " << e + added.size() << " " << update << " " << watch.seconds() << " "
+						<< fier.root().size() << " " << fier.node_timing().nodes();
+					CHECK(fier.root().size() == retrained.root().size());
+				}
+			}
+	}
+} c4_033;
 
 class FeatureStatistics: public Experiment {
 public:
@@ -288,17 +537,19 @@ public:
 		file() << "region piece count wins losses draws";
 		const std::vector<Piece> pieces({Piece('-'), Piece('o'), Piece('x')});
 		auto program = load_program(data_dir()+"\\regions.txt");
+		std::vector<std::string> names;
+		std::vector<Region> regions;
 		FOR_EACH(nr,program->regions()) {
-			auto n = nr->first;
-			auto r = nr->second;
-			FOR_EACH(p,pieces) {
-				std::map<int,DataStat> counts;
-				FOR_EACH(b,data) 
-					counts[b->first.count(r,*p)].inc(b->second);
-				FOR_EACH(c,counts)
-					file() << n << " " << *p << " " << c->first << " " << c->second;	
-			}
+			names.push_back(nr->first);
+			regions.push_back(nr->second);
 		}
+		const OutcomeProfile profile(data.map(), regions, pieces);
+		for (size_t r = 0; r < regions.size(); r++)
+			for (size_t p = 0; p < pieces.size(); p++)
+				for (int c = 0; c <= OutcomeProfile::square_count; c++)
+					if (profile.occupancy(r, p, c) > 0)
+						file() << names[r] << " " << pieces[p] << " " << c << " "
+							<< DataStat([&](const MatchOutcome o) {return profile.occupancy(r, p, c, o);});
 	}
 } c4_030;
 
@@ -318,18 +569,29 @@ struct AnnotatedData {
 	const MatchOutcome outcome;
 };
 
+typedef std::vector<AnnotatedData> annotated_rows_t;
+
+/** the annotated boards of data, in the order of its rows, for the databases of every region file to share */
+std::shared_ptr<const annotated_rows_t> annotate(const IcuData& data) {
+	std::shared_ptr<annotated_rows_t> result = std::make_shared<annotated_rows_t>();
+	result->reserve(data.size());
+	for (auto &e : *data.rows())
+		result->emplace_back(AnnotatedBoard(e.first), e.second);
+	return result;
+}
+
 class AnnotatedDatabase: public ID3NameResolver {
 	private:
 		const std::string region_file_name_;
+		const std::shared_ptr<const annotated_rows_t> rows_;
 	public:
-		std::vector<AnnotatedData> items;
+		const annotated_rows_t &items;
 		std::vector<attrib_type2> attribs;
+		std::vector<const Region*> regions; // of attribs, looked up once so that value_of can run in parallel
 		std::unique_ptr<FeatureProgram> program;
 		std::map<int, std::string> names;
-		const IcuData& data_;
-		AnnotatedDatabase(const std::string& region_file_name, const IcuData& data) :
-			region_file_name_(region_file_name), data_(data) {
-			collect_annos();
+		AnnotatedDatabase(const std::string& region_file_name, std::shared_ptr<const annotated_rows_t> rows) :
+			region_file_name_(region_file_name), rows_(rows), items(*rows_) {
 			collect_attribs();
 		}
 		std::string value_name(const size_t a, const size_t v) override {
@@ -350,12 +612,6 @@ class AnnotatedDatabase: public ID3NameResolver {
 		virtual ~AnnotatedDatabase() {
 		}
 	private:
-		void collect_annos() {
-
-			items.reserve(data_.size());
-			FOR_EACH(i,data_)
-				items.emplace_back(AnnotatedBoard(i->first), i->second);
-		}
 		void collect_attribs() {
 			const auto &pieces = annotation_pieces();
 			program = std::move(load_program(region_file_name_));
@@ -364,6 +620,7 @@ class AnnotatedDatabase: public ID3NameResolver {
 				FOR_EACH(p,pieces)
 				{
 					attribs.emplace_back(nr->first, *p);
+					regions.push_back(&nr->second);
 				}
 		}
 
@@ -380,7 +637,7 @@ public:
 
 	int value_of(const size_t element, const size_t attribute) override	{
 		const auto &b = db->items[element].board;
-		const auto &r = db->program->regions()[db->attribs[attribute].first];
+		const auto &r = *db->regions[attribute];
 		const auto &p = db->attribs[attribute].second;
 		return b.count(r,p) > 0 ? 1 : 0;
 	}
@@ -392,19 +649,25 @@ public:
 	Classify(): Experiment("c4-300","Find a good cutoff value for ID3") {}
 	void do_run() override {
 		auto datadir = args()["data_dir"];
-		IcuData data(datadir + "/downloaded/connect-4.data");
-		AnnotatedDatabase db(datadir + "\\regions.txt", data);
-		file() << "fraction cutoff size certainty";
-		for (int f = 3; f < 10; f++) {
-			for (int i = 0; i < 10; i++) {
-				const int cutoff = i * 32;
-				LOG << "At " << f << ":" << i;
-				std::cout << "At " << f << ":" << i;
-				AnnotatedClassifier cf(&db,cutoff);
-				cf.train_and_test(db.items.size(),db.attribs.size(),f);
-				file() << f << " " << cutoff << " " << cf.root().size() <<" " << cf.root().certainty();
-			}
+		AnnotatedDatabase db(datadir + "\\regions.txt", annotate(IcuData(datadir + "/downloaded/connect-4.data")));
+		AnnotatedClassifier cf(&db,0);
+		cf.encode(db.items.size(),db.attribs.size());
+		WorkerPool pool;
+		ID3Sweep sweep(pool);
+		sweep.add_data(cf.matrix());
+		// fraction f tests on every f-th element and trains on the others
+		const int first_fraction = 3;
+		for (int f = first_fraction; f < 10; f++) {
+			std::forward_list<size_t> training, test;
+			for (size_t e = 0; e < db.items.size(); e++)
+				(e % f == 0 ? test : training).push_front(e);
+			sweep.add_test(sweep.add_fold(training), test);
 		}
+		for (int i = 0; i < 10; i++)
+			sweep.add_cut_off(i * 32);
+		file() << "fraction cutoff size certainty seconds";
+		for (auto &r : sweep.run())
+			file() << r.fold + first_fraction << " " << r.cut_off << " " << r.size << " " << r.accuracy << " " << r.seconds;
 	}
 } c4_300;
 
@@ -414,7 +677,7 @@ class ClassifyRegions: public Experiment {
 public:
 		ClassifyRegions() : Experiment("c4-400","Which regions classifies better?") {}
 		void do_run() override {
-			IcuData data(data_fn("downloaded/connect-4.data"));
+			const auto data = annotate(IcuData(data_fn("downloaded/connect-4.data")));
 			file() << "region size certainty";
 			do_step("regions.txt","all-lines",data);
 			do_step("regions-diag.txt","diagonal-lines",data);
@@ -422,12 +685,75 @@ public:
 			do_step("regions-cr.txt", "adjacent-lines",data);
 		}
 private:
-		void do_step(const string& filename, const string& regionname, const IcuData& data) {
+		void do_step(const string& filename, const string& regionname, std::shared_ptr<const annotated_rows_t> data) {
 			AnnotatedDatabase db(data_fn(filename), data);
 			AnnotatedClassifier cf(&db,64);
+			cf.encode(db.items.size(),db.attribs.size());
 			cf.train_and_test(db.items.size(),db.attribs.size(),9);
 			file() << regionname << " " << cf.root().size() <<" " << cf.root().certainty();
 		}
 } c4_400;
 
 
+
+/**
+ * Replays the region counting of the c4-300/c4-400 workloads.  The set
+ * counts walk a std::set<Square> per region, the way Region used to be stored; 
+ * the mask counts use Board::count.  The encoded rows time the same training
+ * from an AttributeMatrix, including the time it takes to encode it.
+ */
+class RegionCountTiming: public Experiment {
+public:
+		RegionCountTiming() : Experiment("c4-310","How long does region counting take in c4-300/c4-400?") {}
+		void do_run() override {
+			const auto data = annotate(IcuData(data_fn("downloaded/connect-4.data")));
+			file() << "regions method seconds";
+			do_step("regions.txt","all-lines",data);
+			do_step("regions-diag.txt","diagonal-lines",data);
+			do_step("regions-sq.txt", "squares",data);
+			do_step("regions-cr.txt", "adjacent-lines",data);
+		}
+private:
+		static int count_by_walk(const Board& b, const std::set<Square>& ss, const Piece &value) {
+			int result = 0;
+			for (auto s = ss.begin(); s != ss.end(); s++)
+				if (b(*s) == value)
+					result++;
+			return result;
+		}
+
+		void do_step(const string& filename, const string& regionname, std::shared_ptr<const annotated_rows_t> data) {
+			AnnotatedDatabase db(data_fn(filename), data);
+			std::vector<std::set<Square>> sets;
+			std::vector<const Region*> regions;
+			for (auto &a : db.attribs) {
+				const auto &r = db.program->regions()[a.first];
+				sets.emplace_back(r.begin(),r.end());
+				regions.push_back(&r);
+			}
+			long walked = 0;
+			Stopwatch watch;
+			for (auto &item : db.items)
+				for (size_t a = 0; a < db.attribs.size(); a++)
+					walked += count_by_walk(item.board,sets[a],db.attribs[a].second);
+			file() << regionname << " set " << watch.seconds();
+			long masked = 0;
+			watch.restart();
+			for (auto &item : db.items)
+				for (size_t a = 0; a < db.attribs.size(); a++)
+					masked += item.board.count(*regions[a],db.attribs[a].second);
+			file() << regionname << " mask " << watch.seconds();
+			CHECK(walked == masked);
+			watch.restart();
+			AnnotatedClassifier cf(&db,64);
+			cf.train_and_test(db.items.size(),db.attribs.size(),9);
+			file() << regionname << " c4-400 " << watch.seconds();
+			watch.restart();
+			AnnotatedClassifier encoded(&db,64);
+			encoded.encode(db.items.size(),db.attribs.size());
+			file() << regionname << " encode " << watch.seconds();
+			encoded.train_and_test(db.items.size(),db.attribs.size(),9);
+			file() << regionname << " encoded-c4-400 " << watch.seconds();
+			CHECK(encoded.root().size() == cf.root().size());
+		}
+} c4_310;
@@ -1,9 +1,10 @@
 #include <experiment.h>
 #include <negamax.h>
+#include <mcts.h>
+#include <tournament.h>
 #include "connect4.h"
 #include <log.h>
 #include <thread>
-#include <future>
 using namespace arti;
 
 class NegamaxExploration : public Experiment {
@@ -20,6 +21,10 @@ protected:
 		PickNegamaxAlphaBeta picker(&Connect4::spec,fn,level,false);
 		picker.select(pos,boards);
 		file() << fn_name << " " << level << " " << picker.walk_count() << " " << picker.value();
+		TranspositionTable table;
+		picker.set_table(&table);
+		picker.select(pos,boards);
+		file() << fn_name << "-T " << level << " " << picker.walk_count() << " " << picker.value();
 	}
 
 
@@ -48,6 +53,11 @@ class NegamaxOrdered : Experiment {
 			PickNegamaxAlphaBeta picker(&Connect4::spec,fn,level,ordered);
 			picker.select(pos,boards);
 			file() << fn_name << (ordered?"-O ":" ") << level << " " << picker.walk_count() << " " << picker.value();
+			TranspositionTable table;
+			picker.set_table(&table);
+			picker.select(pos,boards);
+			file() << fn_name << (ordered?"-OT ":"-T ") << level << " " << picker.walk_count() << " " << picker.value()
+				<< " (" << picker.hit_count() << " hits " << picker.miss_count() << " misses " << picker.collision_count() << " collisions)";
 		}
 
 
@@ -69,6 +79,172 @@ class NegamaxOrdered : Experiment {
 		}
 } c4_200;
 
+class BoardTiming : public Experiment {
+	public:
+		BoardTiming() : Experiment("c4-120", "How fast are the board operations that search and ID3 depend on?") {}
+	protected:
+		void do_run() override {
+			file() << "Measurement Count Seconds";
+			// collect the positions of random matches
+			PickRandom randpick(Connect4::spec);
+			std::vector<Board> boards;
+			while (boards.size() < 100000) {
+				Match m(Connect4::spec,randpick);
+				m.play();
+				for (auto &p : m.line().sequence())
+					boards.push_back(p->board());
+			}
+			Stopwatch watch;
+			std::vector<Board> copies;
+			copies.reserve(boards.size());
+			for (int i = 0; i < 10; i++) {
+				copies.clear();
+				for (auto &b : boards) copies.push_back(b);
+			}
+			file() << "Copy " << boards.size()*10 << " " << watch.seconds();
+			watch.restart();
+			long plies = 0;
+			for (auto &b : boards) plies += ply_of(b);
+			file() << "Count " << boards.size() << " " << watch.seconds();
+			watch.restart();
+			long wins = 0;
+			for (auto &b : boards) {
+				PositionThatPoints pos(ply_of(b),&b);
+				if (Connect4::spec.outcome_of(pos) != Unknown) wins++;
+			}
+			file() << "Outcome " << boards.size() << " " << watch.seconds();
+			watch.restart();
+			for (auto &b : boards) AnnotatedBoard a(b);
+			file() << "Annotate " << boards.size() << " " << watch.seconds();
+			watch.restart();
+			long moves_made = 0;
+			for (auto &b : boards) {
+				Board::u_ptr_list children;
+				moves_made += Connect4::spec.collectBoards(PositionThatPoints(ply_of(b),&b),children);
+			}
+			file() << "CollectBoards " << boards.size() << " " << watch.seconds();
+			watch.restart();
+			for (auto &b : boards) {
+				Board w(b);
+				CompactMove moves[GameSpecification::max_moves];
+				const int count = Connect4::spec.collect_moves(PositionThatPoints(ply_of(w),&w),moves);
+				for (int i = 0; i < count; i++) {
+					Connect4::spec.make_move(w,moves[i]);
+					Connect4::spec.unmake_move(w,moves[i]);
+				}
+			}
+			file() << "MakeUnmake " << boards.size() << " " << watch.seconds();
+			LOG << plies << " plies, " << wins << " outcomes and " << moves_made << " moves";
+			for (int level = 5; level < 9; level++) {
+				watch.restart();
+				Board::u_ptr board(new Board());
+				Connect4::spec.setup(*board);
+				PositionThatOwns pos(0, std::move(board));
+				Board::u_ptr_list children;
+				Connect4::spec.collectBoards(pos,children);
+				PickNegamaxAlphaBeta picker(&Connect4::spec,Connect4::StenMarkIBEF,level);
+				picker.select(pos,children);
+				file() << "Negamax-" << level << " " << picker.walk_count() << " " << watch.seconds();
+			}
+		}
+} c4_120;
+
+/* Keeps the latency and depth of the moves of a PickNegamaxAlphaBeta */
+class TimedChooser : public MoveChooser {
+	public:
+		PickNegamaxAlphaBeta& picker;
+		int moves;
+		int depths;
+		double total;
+		double longest;
+		TimedChooser(PickNegamaxAlphaBeta& p) : picker(p), moves(0), depths(0), total(0), longest(0) {}
+		Board::u_ptr_it select(const Position & current, Board::u_ptr_list &children) override {
+			Stopwatch watch;
+			auto result = picker.select(current, children);
+			const double s = watch.seconds();
+			moves++;
+			depths += picker.depth_reached();
+			total += s;
+			longest = std::max(longest, s);
+			return result;
+		}
+};
+
+class DeepeningLatency : public Experiment {
+	public:
+		DeepeningLatency() : Experiment("c4-130", "Does iterative deepening give a predictable time per move?") {}
+	protected:
+		void do_step(const char * name, const int ply, const double seconds, const int nodes) {
+			PickRandom randpick(Connect4::spec);
+			PickNegamaxAlphaBeta negapick(&Connect4::spec,Connect4::StenMarkIBEF,ply);
+			negapick.set_budget(seconds,nodes);
+			TimedChooser timed(negapick);
+			PickDual dual(timed,randpick);
+			for (int i = 0; i < 20; i++)
+				Match(Connect4::spec,dual).play();
+			file() << name << " " << timed.moves << " " << (float) timed.depths / timed.moves << " "
+				<< timed.total / timed.moves << " " << timed.longest;
+		}
+
+		void do_run() override {
+			file() << "Search Moves Depth MeanSeconds MaxSeconds";
+			do_step("Depth-6", 6, 0, 0);
+			do_step("Depth-8", 8, 0, 0);
+			do_step("Time-0.005", 42, 0.005, 0);
+			do_step("Time-0.02", 42, 0.02, 0);
+			do_step("Nodes-5000", 42, 0, 5000);
+			do_step("Nodes-20000", 42, 0, 20000);
+		}
+} c4_130;
+
+class ParallelSpeedup : public Experiment {
+	public:
+		ParallelSpeedup() : Experiment("c4-140", "How much faster is a single move decision on all cores?") {}
+	protected:
+		void do_step(const int level, const unsigned threads, double &single) {
+			Board::u_ptr board(new Board());
+			Connect4::spec.setup(*board);
+			PositionThatOwns pos(0, std::move(board));
+			Board::u_ptr_list boards;
+			Connect4::spec.collectBoards(pos,boards);
+			Stopwatch watch;
+			if (threads == 1) {
+				TranspositionTable table;
+				PickNegamaxAlphaBeta picker(&Connect4::spec,Connect4::StenMarkIBEF,level);
+				picker.set_table(&table);
+				picker.select(pos,boards);
+				single = watch.seconds();
+				file() << level << " 1 " << single << " 1 " << picker.value() << " " << picker.walk_count();
+			} else {
+				PickParallelNegamax picker(&Connect4::spec,Connect4::StenMarkIBEF,level,threads);
+				picker.select(pos,boards);
+				const double s = watch.seconds();
+				file() << level << " " << threads << " " << s << " " << single / s << " " << picker.value() << " " << picker.walk_count()
+					<< " " << to_string(picker.thread_walk_counts());
+			}
+		}
+
+		static std::string to_string(const std::vector<int>& counts) {
+			std::string result;
+			for (auto c : counts) {
+				if (!result.empty()) result.push_back(',');
+				result += std::to_string(c);
+			}
+			return result;
+		}
+
+		void do_run() override {
+			file() << "Depth Threads Seconds Speedup Value Positions PerThread";
+			const unsigned cores = std::max(1U, std::thread::hardware_concurrency());
+			for (int level = 8; level < 12; level++) {
+				double single = 0;
+				do_step(level, 1, single);
+				for (unsigned t = 2; t <= std::max(4U,cores); t *= 2)
+					do_step(level, t, single);
+			}
+		}
+} c4_140;
+
 static arti::MatchOutcome play_m(Match& m) {
 	return m.play();
 }
@@ -76,9 +252,9 @@ static arti::MatchOutcome play_m(Match& m) {
 // 7353:> Complete c4-350 - first and second player
 class PerformanceMeasurements : Experiment {
 	public:
-		PerformanceMeasurements() : Experiment("c4-350","What affect does search depth have on performance? (2h)") {}
+		PerformanceMeasurements() : Experiment("c4-350","What affect does search depth have on performance?") {}
 		void do_run() override {
-			file() << "Function Depth Performance";
+			file() << "Function Depth Performance Error Games Wins Draws Losses Elo EloError";
 			do_step("IBEF",Connect4::StenMarkIBEFB,true,false);
 			do_step("ADATE",Connect4::StenMarkADATEB,true,false);
 			do_step("IBEF_S",Connect4::StenMarkIBEF,true,false);
@@ -89,58 +265,125 @@ class PerformanceMeasurements : Experiment {
 		}
 	private:
 		void do_step(const string& fname, eval_function_t fn,const bool play_first, const bool play_second, const int s=1, const int e=6) {
+			// performance within 1 point, 95% of the time
+			const ConfidenceRule rule(0.01f);
 			for (int p=s; p <= e;p++) {
-				auto r = p_metric(fn,p,play_first,play_second);
-				file() << fname << " " << p << " " << r;
-				LOG << fname << " " << p << " " << r ;
+				auto r = p_metric(fn,p,play_first,play_second,rule);
+				file() << fname << " " << p << " " << 100 * r.score() << " " << 100 * r.error() << " " << r.games()
+					<< " " << r.wins() << " " << r.draws() << " " << r.losses() << " " << r.elo() << " " << r.elo_error();
+				LOG << fname << " " << p << " " << 100 * r.score() << " +- " << 100 * r.error();
 			}
 		}
 
-		void adjust_counts(const MatchOutcome result,const MatchOutcome whoami, int &w, int &l) {
-			CHECK(result != MatchOutcome::Unknown);
-			if (result == whoami) w = w + 1;
-			else if (result != MatchOutcome::Draw) l = l + 1;
+		/* The score of negamax against random, until rule is satisfied or N pairs have been played */
+		MatchScore p_metric(eval_function_t fn, const int ply, const bool play_first, const bool play_second, const StoppingRule& rule) {
+			CHECK(play_first || play_second);
+			const int N = 3000; // the most number of 'pair' matches to play where pair = one match on each side
+			Tournament tournament(Connect4::spec);
+			auto negamax = [fn,ply](const unsigned) {
+				return std::unique_ptr<MoveChooser>(new PickNegamaxAlphaBeta(&Connect4::spec,fn,ply));
+			};
+			auto random = [](const unsigned seed) {
+				return std::unique_ptr<MoveChooser>(new PickRandom(Connect4::spec,seed));
+			};
+			const int first = play_first ? tournament.add(negamax,random,N) : -1;
+			if (play_second) tournament.add(random,negamax,N);
+			MatchScore score;
+			tournament.play([&](const Tournament::MatchResult& r) {
+				CHECK(r.outcome != MatchOutcome::Unknown);
+				score.add(r.outcome, r.pairing == first ? Side::South : Side::North);
+				if (rule.done(score))
+					tournament.stop();
+			});
+			return score;
 		}
+} c4_350;
 
-		float p_metric(eval_function_t fn, const int ply, const bool play_first, const bool play_second) {
-			CHECK(play_first || play_second);
-			const int N = 3000; // the number of 'pair' matches to play where pair = one match on each side
-			const int LOAD = 16;  // the number of futures to submit asynchronously; depends on the number of cores available
+class MonteCarloStrength : Experiment {
+	public:
+		MonteCarloStrength() : Experiment("c4-360","How strong is Monte Carlo tree search compared to negamax?") {}
+		void do_run() override {
+			file() << "Playouts Opponent Performance PlayoutsPerSecond";
+			for (int playouts = 500; playouts <= 8000; playouts *= 4) {
+				do_step(playouts, "Random", nullptr);
+				PickNegamaxAlphaBeta ibef(&Connect4::spec,Connect4::StenMarkIBEFB,4);
+				do_step(playouts, "IBEF-4", &ibef);
+				PickNegamaxAlphaBeta adate(&Connect4::spec,Connect4::StenMarkADATEB,4);
+				do_step(playouts, "ADATE-4", &adate);
+			}
+		}
+	private:
+		/* Play N matches on each side against opponent, or random when it is null */
+		void do_step(const int playouts, const char * name, MoveChooser * opponent) {
+			const int N = 20;
 			PickRandom randpick(Connect4::spec);
-			int wp = 0;
-			int lp = 0;
-			int total = 0;
-			using future_t = std::future<arti::MatchOutcome>;
-			int count = 0;
-			while (count < N) {
-				std::list<future_t> flist,llist;
-				int step = LOAD;
-				if (step + count > N)
-					step = N - count;
-				for (int i=0;i<step;i++) {
-					if (play_first) flist.emplace_front(
-						std::async(std::launch::async,
-							[&ply,&fn,&randpick](){
-								PickNegamaxAlphaBeta negapick(&Connect4::spec,fn,ply);
-								PickDual first(negapick,randpick);
-								return Match(Connect4::spec,first).play();
-							}));
-					if (play_second) llist.emplace_front(
-						std::async(std::launch::async,
-							[&ply,&fn,&randpick](){
-								PickNegamaxAlphaBeta negapick(&Connect4::spec,fn,ply);
-								PickDual last(randpick,negapick);
-								return Match(Connect4::spec,last).play();
-							}));
-				};
-				for (auto &f : flist)
-					adjust_counts(f.get(),SouthPlayerWins,wp,lp);
-				for (auto &f : llist)
-					adjust_counts(f.get(),NorthPlayerWins,wp,lp);
-				count += step;
-				total += (flist.size() + llist.size());
+			MoveChooser& other = opponent ? *opponent : randpick;
+			PickMonteCarlo mcts(&Connect4::spec, playouts, 0, 0);
+			int w = 0, l = 0, total = 0;
+			for (int i = 0; i < N; i++) {
+				PickDual first(mcts,other);
+				Match m1(Connect4::spec,first);
+				const auto r1 = m1.play();
+				PickDual last(other,mcts);
+				Match m2(Connect4::spec,last);
+				const auto r2 = m2.play();
+				if (r1 == SouthPlayerWins) w++; else if (r1 == NorthPlayerWins) l++;
+				if (r2 == NorthPlayerWins) w++; else if (r2 == SouthPlayerWins) l++;
+				total += 2;
 			}
-			CHECK(count == N);
-			return 100 * (total+wp-lp)/(total*2.0f);
+			const float performance = 100 * (total+w-l)/(total*2.0f);
+			file() << playouts << " " << name << " " << performance << " " << mcts.total_playouts() / mcts.total_seconds();
+			LOG << playouts << " " << name << " " << performance;
 		}
-} c4_350;
+} c4_360;
+
+class DepthSprt : Experiment {
+	public:
+		DepthSprt() : Experiment("c4-370","Is negamax one ply deeper at least 50 Elo stronger?") {}
+		void do_run() override {
+			file() << "Function Depth Decision Games Wins Draws Losses Elo EloError LLR";
+			const SprtRule rule(0, 50);
+			for (int ply = 1; ply < 6; ply++) {
+				do_step("IBEF", Connect4::StenMarkIBEFB, ply, rule);
+				do_step("ADATE", Connect4::StenMarkADATEB, ply, rule);
+			}
+		}
+	private:
+		/* Play depth ply+1 against depth ply, on both sides, until the test decides */
+		void do_step(const char * name, eval_function_t fn, const int ply, const SprtRule& rule) {
+			Tournament tournament(Connect4::spec);
+			auto deeper = [fn,ply](const unsigned) {
+				return std::unique_ptr<MoveChooser>(new PickNegamaxAlphaBeta(&Connect4::spec,fn,ply+1));
+			};
+			auto shallow = [fn,ply](const unsigned) {
+				return std::unique_ptr<MoveChooser>(new PickNegamaxAlphaBeta(&Connect4::spec,fn,ply));
+			};
+			// negamax is deterministic, so random openings give the matches their variety
+			auto opening = [](const Tournament::chooser_factory_t& f) {
+				return [f](const unsigned seed) {return std::unique_ptr<MoveChooser>(new RandomOpening(f(seed), seed));};
+			};
+			const int first = tournament.add(opening(deeper),opening(shallow),5000);
+			tournament.add(opening(shallow),opening(deeper),5000);
+			MatchScore score;
+			tournament.play([&](const Tournament::MatchResult& r) {
+				score.add(r.outcome, r.pairing == first ? Side::South : Side::North);
+				if (rule.done(score))
+					tournament.stop();
+			});
+			file() << name << " " << ply + 1 << " " << rule.decision(score) << " " << score.games()
+				<< " " << score.wins() << " " << score.draws() << " " << score.losses()
+				<< " " << score.elo() << " " << score.elo_error() << " " << rule.llr(score);
+		}
+
+		/* Plays the first two moves of each side at random */
+		class RandomOpening : public MoveChooser {
+			public:
+				RandomOpening(std::unique_ptr<MoveChooser> chooser, const unsigned seed) : chooser_(std::move(chooser)), random_(Connect4::spec,seed) {}
+				Board::u_ptr_it select(const Position & current, Board::u_ptr_list &children) override {
+					return current.ply().index() < 4 ? random_.select(current,children) : chooser_->select(current,children);
+				}
+			private:
+				std::unique_ptr<MoveChooser> chooser_;
+				PickRandom random_;
+		};
+} c4_370;
@@ -4,7 +4,14 @@
 #include <test_util.h>
 #include "connect4.h"
 #include "icu_data.h"
+#include <negamax.h>
+#include <mcts.h>
+#include <tournament.h>
 #include <log.h>
+#include <icureader.h>
+#include <outcomecache.h>
+#include <fstream>
+#include <cstdio>
 #define TESTDATA connect4TestData
 namespace tut {
 	using namespace std;
@@ -13,6 +20,28 @@ namespace tut {
 	struct connect4TestData {
 	};
 
+	/** three rows of connect-4.data: a win, a loss and a draw, in the format of IcuData */
+	const std::string icu_rows[] = {
+		"b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,x,win",
+		"x,o,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,loss",
+		"o,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,b,draw"};
+	const IcuFormat icu_format = {7, 6, 'b', '-', {{"win", SouthPlayerWins}, {"loss", NorthPlayerWins}}, Draw};
+
+	/** A file that is removed at the end of the test, also when the test fails */
+	class TempFile {
+		PREVENT_COPY(TempFile)
+		public:
+			explicit TempFile(const std::string &name) : name_(name) {std::remove(name_.c_str());}
+			~TempFile() {std::remove(name_.c_str());}
+			const std::string& name() const {return name_;}
+			void write(const std::string &text, const bool append = false) {
+				std::ofstream out(name_, append ? std::ios::binary | std::ios::app : std::ios::binary);
+				out << text;
+			}
+		private:
+			const std::string name_;
+	};
+
 	test_group<connect4TestData> connect4Tests("010 Connect4 Play Tests");
 
 	BEGIN(1,"Simple Play Sequence")
@@ -28,8 +57,322 @@ namespace tut {
 		//ensure_equals(match.outcome(), MatchOutcome::SouthPlayerWins);
 	END
 
-	// BEGIN(2, "Load test") 
-	// 	IcuData d;
-	// 	LOG << d.entries()[0].board();
-	// END
+	BEGIN(2,"Compact moves follow collectBoards and unmake restores")
+		Connect4 spec;
+		PickFirst picker;
+		Match match(spec,picker);
+		match.play();
+		for (auto &p : match.line().sequence()) {
+			Board::u_ptr_list boards;
+			spec.collectBoards(*p, boards);
+			CompactMove moves[GameSpecification::max_moves];
+			const int count = spec.collect_moves(*p, moves);
+			ensure_equals("move count", count, (int) boards.size());
+			Board b(p->board());
+			int i = 0;
+			for (auto &child : boards) {
+				spec.make_move(b, moves[i]);
+				ensure("made move differs", b == *child);
+				spec.unmake_move(b, moves[i]);
+				ensure("unmake differs", b == p->board());
+				ensure_equals("unmake hash", b.hash(), p->board().hash());
+				i++;
+			}
+		}
+	END
+
+	BEGIN(3,"Transposition table keeps the value and walks less")
+		Board::u_ptr board(new Board());
+		Connect4::spec.setup(*board);
+		PositionThatOwns pos(0, std::move(board));
+		Board::u_ptr_list boards;
+		Connect4::spec.collectBoards(pos,boards);
+		PickNegamaxAlphaBeta plain(&Connect4::spec,Connect4::StenMarkIBEF,6);
+		auto plain_it = plain.select(pos,boards);
+		TranspositionTable table(1);
+		PickNegamaxAlphaBeta with_table(&Connect4::spec,Connect4::StenMarkIBEF,6);
+		with_table.set_table(&table);
+		auto table_it = with_table.select(pos,boards);
+		ensure_equals("value", with_table.value(), plain.value());
+		ensure("same move", table_it == plain_it);
+		ensure("fewer walks", with_table.walk_count() < plain.walk_count());
+		ensure("table used", with_table.hit_count() > 0);
+		ensure_equals("no counts without table", plain.hit_count() + plain.miss_count() + plain.collision_count(), 0);
+	END
+
+	BEGIN(4,"Iterative deepening stays within the node budget")
+		Board::u_ptr board(new Board());
+		Connect4::spec.setup(*board);
+		PositionThatOwns pos(0, std::move(board));
+		Board::u_ptr_list boards;
+		Connect4::spec.collectBoards(pos,boards);
+		PickNegamaxAlphaBeta fixed(&Connect4::spec,Connect4::StenMarkIBEF,5);
+		fixed.select(pos,boards);
+		PickNegamaxAlphaBeta deepening(&Connect4::spec,Connect4::StenMarkIBEF,5);
+		deepening.set_budget(0, 1000000);
+		auto it = deepening.select(pos,boards);
+		ensure_equals("completes all depths", deepening.depth_reached(), 5);
+		ensure_equals("same value", deepening.value(), fixed.value());
+		ensure("selects a move", it != boards.end());
+		PickNegamaxAlphaBeta limited(&Connect4::spec,Connect4::StenMarkIBEF,20);
+		limited.set_budget(0, 2000);
+		limited.select(pos,boards);
+		ensure("stops deepening", limited.depth_reached() > 0 && limited.depth_reached() < 20);
+		ensure("within budget", limited.walk_count() <= 2000);
+	END
+
+	BEGIN(5,"Parallel search")
+		Board::u_ptr board(new Board());
+		Connect4::spec.setup(*board);
+		PositionThatOwns pos(0, std::move(board));
+		Board::u_ptr_list boards;
+		Connect4::spec.collectBoards(pos,boards);
+		PickNegamaxAlphaBeta single(&Connect4::spec,Connect4::StenMarkIBEF,6);
+		auto single_it = single.select(pos,boards);
+		PickParallelNegamax one(&Connect4::spec,Connect4::StenMarkIBEF,6,1,1);
+		ensure("one thread is the single search", one.select(pos,boards) == single_it);
+		ensure_equals("value of one thread", one.value(), single.value());
+		PickParallelNegamax parallel(&Connect4::spec,Connect4::StenMarkIBEF,6,3,1);
+		auto it = parallel.select(pos,boards);
+		ensure("selects a move", it != boards.end());
+		ensure_equals("threads", parallel.thread_walk_counts().size(), 3U);
+		ensure_equals("walks", parallel.walk_count(),
+			parallel.thread_walk_counts()[0] + parallel.thread_walk_counts()[1] + parallel.thread_walk_counts()[2]);
+	END
+
+	BEGIN(6,"Monte Carlo search takes a win")
+		Board::u_ptr board(new Board());
+		Connect4::spec.setup(*board);
+		for (index_t f = 0; f < 3; f++) {
+			(*board)(f, 0, Connect4::south);
+			(*board)(f, 1, Connect4::north);
+		}
+		PositionThatOwns pos(6, std::move(board));
+		Board::u_ptr_list boards;
+		Connect4::spec.collectBoards(pos,boards);
+		PickMonteCarlo mcts(&Connect4::spec, 2000, 0, 2);
+		auto it = mcts.select(pos,boards);
+		ensure("selects a move", it != boards.end());
+		ensure_equals("takes the win", (**it)(3,0), Connect4::south);
+		ensure_equals("playouts", mcts.playout_count(), 2000);
+		PickMonteCarlo few(&Connect4::spec, 3, 0, 4);
+		ensure("few playouts select a move", few.select(pos,boards) != boards.end());
+		ensure_equals("fewer playouts than threads", few.playout_count(), 3);
+	END
+
+	BEGIN(7,"Tournament outcomes do not depend on the workers")
+		auto random = [](const unsigned seed) {
+			return std::unique_ptr<MoveChooser>(new PickRandom(Connect4::spec,seed));
+		};
+		std::vector<MatchOutcome> outcomes[2];
+		for (unsigned w = 1; w <= 2; w++) {
+			Tournament tournament(Connect4::spec, w * 2, 7);
+			tournament.add(random, random, 10);
+			tournament.add(random, random, 10);
+			auto& o = outcomes[w-1];
+			o.resize(20, MatchOutcome::Unknown);
+			tournament.play([&o](const Tournament::MatchResult& r) {
+				o[r.pairing * 10 + r.match] = r.outcome;
+			});
+		}
+		for (int i = 0; i < 20; i++) {
+			ensure("played", outcomes[0][i] != MatchOutcome::Unknown);
+			ensure_equals("same outcome", outcomes[0][i], outcomes[1][i]);
+		}
+	END
+
+	BEGIN(8,"Match scores and stopping rules")
+		MatchScore even;
+		for (int i = 0; i < 150; i++) {
+			even.add(SouthPlayerWins, Side::South);
+			even.add(SouthPlayerWins, Side::North);
+		}
+		ensure_equals("games", even.games(), 300);
+		ensure_equals("score", even.score(), 0.5f);
+		ensure("elo", std::abs(even.elo()) < 1e-3f);
+		ensure("error", std::abs(even.error() - 0.0566f) < 1e-3f);
+		ensure("elo round trip", std::abs(MatchScore::score_of(MatchScore::elo_of(0.75f)) - 0.75f) < 1e-5f);
+		const SprtRule sprt(0, 50);
+		ensure_equals("even accepts H0", sprt.decision(even), -1);
+		MatchScore strong;
+		for (int i = 0; i < 60; i++)
+			strong.add(i % 4 == 0 ? Draw : NorthPlayerWins, Side::North);
+		ensure_equals("strong accepts H1", sprt.decision(strong), 1);
+		ensure("wide interval", !ConfidenceRule(0.01f).done(even));
+		ensure("narrow interval", ConfidenceRule(0.06f).done(even));
+	END
+
+	BEGIN(9, "Load test")
+		TempFile file("icu_test.data");
+		file.write(icu_rows[0] + "\r\n" + icu_rows[1] + "\n\n" + icu_rows[0] + "\n" + icu_rows[2]);
+		IcuData data(file.name());
+		ensure_equals(data.size(), 3U);
+		Board won;
+		for (int i = 0; i < 7; i++)
+			for (int j = 0; j < 6; j++)
+				won(i,j,Piece('-'));
+		won(6,5,Piece('x'));
+		ensure_equals(data.at(won), SouthPlayerWins);
+		// one range per thread; the rows of every range land in their place
+		std::string text;
+		for (int i = 0; i < 300; i++)
+			text += icu_rows[i % 3] + (i % 2 ? "\r\n" : "\n");
+		IcuReader reader(icu_format, false, 3), deduplicating(icu_format, true, 3);
+		const auto all = reader.parse(text.data(), text.data() + text.size());
+		ensure_equals(all.size(), 300U);
+		for (int i = 0; i < 300; i++)
+			ensure_equals(all[i].outcome, i % 3 == 0 ? SouthPlayerWins : i % 3 == 1 ? NorthPlayerWins : Draw);
+		ensure(all[1].board.at(0,1) == Piece('o'));
+		const auto unique = deduplicating.parse(text.data(), text.data() + text.size());
+		ensure_equals(unique.size(), 3U);
+		ensure_equals(deduplicating.duplicates(), 297U);
+		ensure_equals(unique[2].outcome, Draw);
+	END
+
+	BEGIN(10, "The data cache is written once and again when the source changes")
+		TempFile file("icu_cache_test.data"), cache("icu_cache_test.cache");
+		const std::string &file_name = file.name(), &cache_name = cache.name();
+		file.write(icu_rows[0] + "\n" + icu_rows[1] + "\n" + icu_rows[0] + "\n");
+		{
+			IcuData first(file_name, cache_name);
+			ensure("written", first.cache()->written());
+			ensure_equals(first.size(), 2U);
+			OutcomeDataTable table(first);
+			OutcomeDataClassifier fier(table);
+			fier.encode();
+			ensure("no encoding yet", !first.cache()->matrix("location", table.fingerprint()));
+			first.cache()->store("location", table.fingerprint(), *fier.matrix());
+		}
+		std::uint64_t fingerprint;
+		{
+			IcuData second(file_name, cache_name);
+			ensure("read in place", !second.cache()->written());
+			const IcuData plain(file_name);
+			ensure("same data", second.map() == plain.map());
+			ensure_equals(second.calculate_stats().squares().size(), plain.calculate_stats().squares().size());
+			ensure_equals(second.calculate_stats().outcome_counts().at(NorthPlayerWins), 1);
+			OutcomeDataTable table(second);
+			const auto matrix = second.cache()->matrix("location", table.fingerprint());
+			ensure("encoding kept", matrix != nullptr);
+			OutcomeDataClassifier fier(table);
+			fier.encode();
+			for (size_t a = 0; a < matrix->attribute_count(); a++)
+				for (size_t e = 0; e < matrix->element_count(); e++)
+					ensure_equals(matrix->value_of(e, a), fier.matrix()->value_of(e, a));
+			ensure("other tables", !second.cache()->matrix("location", table.fingerprint() + 1));
+			fingerprint = table.fingerprint();
+		}
+		file.write(icu_rows[2] + "\n", true);
+		{
+			IcuData changed(file_name, cache_name);
+			ensure("written again", changed.cache()->written());
+			ensure_equals(changed.size(), 3U);
+			ensure("encoding dropped", !changed.cache()->matrix("location", fingerprint));
+		}
+		{
+			std::fstream damage(cache_name, std::ios::binary | std::ios::in | std::ios::out);
+			damage.seekp(100);
+			damage.put('?');
+		}
+		ensure("damage is found", IcuData(file_name, cache_name).cache()->written());
+		// the same size, and most likely the same second
+		std::string other = icu_rows[0];
+		other[other.size() - 5] = 'o';
+		file.write(other + "\n" + icu_rows[1] + "\n" + icu_rows[0] + "\n" + icu_rows[2] + "\n");
+		IcuData rewritten(file_name, cache_name);
+		ensure("a rewrite of the same size is found", rewritten.cache()->written());
+		ensure_equals(rewritten.size(), 4U);
+	END
+
+	BEGIN(11, "Tables and views share the rows of their data")
+		const std::string text = icu_rows[0] + "\n" + icu_rows[1] + "\n" + icu_rows[2] + "\n";
+		OutcomeData data;
+		data.add_rows(IcuReader(icu_format).parse(text.data(), text.data() + text.size()));
+		const OutcomeStats stats = data.calculate_stats();
+		OutcomeDataTable table(data, stats);
+		ensure("the table reads the store of the data", table.rows() == data.rows());
+		LocationEncoder other(stats.squares(), stats.pieces());
+		DataTableWithEncoder reencoded(other, table);
+		const std::vector<uint32_t> elements = {2, 0};
+		DataTableWithEncoder view(other, table, elements);
+		DataTableWithEncoder view_of_view(other, view, std::vector<uint32_t>(1, 1));
+		ensure_equals(reencoded.data_count(), 3);
+		ensure_equals(view.data_count(), 2);
+		ensure_equals(view_of_view.data_count(), 1);
+		for (size_t i = 0; i < elements.size(); i++) {
+			ensure_equals(view.class_of(i), table.class_of(elements[i]));
+			for (int a = 0; a < table.attribute_count(); a++)
+				ensure_equals(view.value_of(i, a), table.value_of(elements[i], a));
+		}
+		ensure_equals(view_of_view.class_of(0), table.class_of(0));
+		ensure("the views read the store of the data", reencoded.rows() == data.rows() && view.rows() == data.rows() && view_of_view.rows() == data.rows());
+		element_index_list_t draws;
+		view.collect(draws, Draw);
+		size_t expected = 0;
+		for (auto e : elements)
+			if (table.class_name(table.class_of(e)) == to_string(Draw)) expected++;
+		ensure_equals(size_of(draws), expected);
+		ensure("other elements", view.fingerprint() != table.fingerprint());
+		ensure_equals(reencoded.fingerprint(), table.fingerprint());
+		bool thrown = false;
+		try {
+			DataTableWithEncoder(other, table, std::vector<uint32_t>(1, 3));
+		} catch (const std::exception &) {
+			thrown = true;
+		}
+		ensure("elements outside the table", thrown);
+		// a row that is added drops the store and the statistics; the table keeps its own rows
+		std::string added = icu_rows[2] + "\n";
+		added[0] = 'x';
+		data.add_rows(IcuReader(icu_format).parse(added.data(), added.data() + added.size()));
+		ensure_equals(data.rows()->size(), 4U);
+		ensure_equals(data.calculate_stats().size(), 4L);
+		ensure_equals(table.data_count(), 3);
+	END
+
+	BEGIN(12, "The profile of rows counts them as the boards do")
+		std::mt19937 engine(12);
+		board_outcomes_t rows;
+		for (int i = 0; i < 9000; i++) {
+			Board b;
+			for (int f = 0; f < 7; f++)
+				for (int r = 0; r < 6; r++) {
+					const auto v = engine() % 4;
+					b(f, r, v == 0 ? Connect4::south : v == 1 ? Connect4::north : Connect4::open);
+				}
+			rows.push_back({b, (MatchOutcome) (engine() % 4)});
+		}
+		const std::vector<Region> regions = {Region(Square(0,0), 0, 1, 6), Region(Square(0,0), 1, 1, 6), Region()};
+		const std::vector<Piece> pieces = {Connect4::open, Connect4::north};
+		const OutcomeProfile profile(rows, regions, pieces, Connect4::open, 3);
+		const OutcomeProfile one(rows, regions, pieces, Connect4::open, 1);
+		std::map<int, long> plies;
+		std::map<MatchOutcome, long> outcomes;
+		long file_norths[7][4] = {};
+		long corner = 0;
+		for (auto &e : rows) {
+			plies[ply_of(e.first) * 4 + e.second]++;
+			outcomes[e.second]++;
+			file_norths[e.first.count(regions[0], Connect4::north)][e.second]++;
+			if (e.first(Square(6,5)) == Connect4::south) corner++;
+		}
+		ensure_equals(profile.size(), 9000);
+		for (int o = 0; o < 4; o++)
+			ensure_equals(profile.outcome_count((MatchOutcome) o), outcomes[(MatchOutcome) o]);
+		for (int ply = 0; ply <= OutcomeProfile::square_count; ply++)
+			for (int o = 0; o < 4; o++) {
+				ensure_equals(profile.ply_count(ply, (MatchOutcome) o), plies[ply * 4 + o]);
+				ensure_equals(one.ply_count(ply, (MatchOutcome) o), profile.ply_count(ply, (MatchOutcome) o));
+			}
+		for (int c = 0; c <= 6; c++)
+			for (int o = 0; o < 4; o++)
+				ensure_equals(profile.occupancy(0, 1, c, (MatchOutcome) o), file_norths[c][o]);
+		ensure_equals(profile.occupancy(2, 0, 0), 9000);
+		ensure_equals(profile.piece_count(Square(6,5), Connect4::south), corner);
+		ensure_equals(profile.piece_count(Square(7,7), Piece::EMPTY), 9000);
+		const OutcomeStats stats = profile.stats();
+		ensure_equals(stats.squares().size(), 42U);
+		ensure_equals(stats.pieces().size(), 3U);
+		ensure_equals(stats.outcome_counts().size(), 4U);
+	END
 }
@@ -1,41 +1,25 @@
 #include <log.h>
 #include <systemex.h>
-#include <sstream>
+#include <icureader.h>
 #include "icu_data.h"
 
 using namespace arti;
 const size_t column_count = 7;
 const size_t row_count = 6;
 
-
-IcuData::IcuData(const std::string& file_name)  {
-	// std::ifstream data("../connect4/data/connect-4.data");
-	std::ifstream data(file_name);
-	if (!data) throw runtime_error_ex("could not open file '%s'", file_name.c_str());
-	std::string s;
-	while (data) {
-		data >> s;
-		if (!data)
-			return;
-		FOR_EACH(c,s) 
-			if (*c == ',') *c = ' ';
-		std::stringstream line(s);
-		arti::Board b;
-		std::string v;
-		for (auto i = 0U; i < column_count; i++)
-			for (auto j = 0U; j < row_count; j++) {
-				line >> v;
-				if (v != "b")
-					b(i,j,arti::Piece(v[0]));
-				else
-					b(i,j,arti::Piece('-'));
-			}
-		MatchOutcome r = MatchOutcome::Draw;
-		line >> v;
-		if (v == "win")
-			r = MatchOutcome::SouthPlayerWins;
-		else if (v == "loss")
-			r = MatchOutcome::NorthPlayerWins;
-		insert({b,r});
-	}	
+IcuData::IcuData(const std::string& file_name, const std::string& cache_name) {
+	// e.g. "../connect4/data/connect-4.data"; a blank square is read as '-'
+	const IcuFormat format = {column_count, row_count, 'b', '-',
+		{{"win", MatchOutcome::SouthPlayerWins}, {"loss", MatchOutcome::NorthPlayerWins}}, MatchOutcome::Draw};
+	if (cache_name.empty()) {
+		IcuReader reader(format);
+		add_rows(reader.read(file_name));
+		return;
+	}
+	cache_.reset(new OutcomeCache(file_name, cache_name, [&]() {
+		IcuReader reader(format, true);
+		return reader.read(file_name);
+	}));
+	add_rows(cache_->begin(), cache_->end());
+	keep_stats(cache_->stats());
 }
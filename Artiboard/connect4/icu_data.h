@@ -1,5 +1,6 @@
 #pragma once
 #include <outcomedata.h>
+#include <outcomecache.h>
 /** Data from http://archive.ics.uci.edu/ml/datasets/Connect-4 
   * This database contains all legal 8-ply positions in the game of 
   * connect-4 in which neither player has won yet, and in which the next move is not forced.
@@ -8,7 +9,12 @@
 	*/
 class IcuData : public arti::OutcomeData {
 public:
-	IcuData(const std::string& filename);
+	/** reads the file, through the image cache_name of it if that is not empty; see arti::OutcomeCache */
+	IcuData(const std::string& filename, const std::string& cache_name = "");
+	/** the image the data was read from; null if there is none */
+	std::shared_ptr<arti::OutcomeCache> cache() const {return cache_;}
+private:
+	std::shared_ptr<arti::OutcomeCache> cache_;
 };
 
 using arti::LocationEncoder;
@@ -33,6 +33,18 @@ public:
 					new StepToPlace(view, piece_for(pos.ply().side_to_move())));
 	};
 
+	/** Every open square, in the (column major) order of collectBoards */
+	int collect_moves(const Position& pos, CompactMove * moves) const override {
+		const Piece& piece = piece_for(pos.ply().side_to_move());
+		int n = 0;
+		for (index_t c = 0; c < 3; c++)
+			for (index_t r = 0; r < 3; r++)
+				if (pos.board()(c, r) == tictacOpen) {
+					moves[n].set(Square(c, r).index(), piece);
+					n++;
+				}
+		return n;
+	}
 
 	MatchOutcome outcome_of(const Position& pos) const override {
 		for (index_t r = 0; r < 3; r++)